@@ -8,609 +8,4939 @@
  * @internal BitStreamCreate
  * 	     BitStreamCreateHex
  * 	     BitStreamCreateAscii
+ * 	     BitStreamCreateBase64
  *           BitStreamDelete
  *           BitStreamRealloc
  *           BitStreamShow
+ *           BitStreamToHex
  *           BitStreamPutByte
  *           BitStreamGetByte
  *           BitStreamPutBits
  *           BitStreamGetBits
+ *           BitReaderInit
+ *           BitReaderPeek
+ *           BitReaderSkip
+ *           BitReaderConsume
+ *           BitWriterInit
+ *           BitWriterPut
+ *           BitWriterFlush
  *	     BitStreamCopy
+ *	     BitStreamCopyBits
  *	     BitStreamCopyHex
+ *	     BitStreamCopyHexN
  *	     BitStreamCopyAscii
+ *	     BitStreamCopyAsciiN
+ *	     BitStreamCopyBase64
+ *	     BitStreamCopyBase64N
  *	     BitStreamFill
  *	     BitStreamHex2Base64
+ *	     BitStreamToBase64
+ *	     HexEncoderUpdate
+ *	     HexDecoderUpdate
+ *	     Base64EncoderUpdate
+ *	     Base64DecoderUpdate
  *	     BitStreamExclusiveOr
+ *	     BitStreamXorInto
+ *	     BitStreamXorInPlace
+ *	     EnglishScore
+ *	     BitStreamEnglishScore
+ *	     BitStreamRankXorKeys
+ *	     LineReaderOpen
+ *	     LineReaderNext
+ *	     LineReaderClose
+ *	     BitStreamAppendBits
+ *	     BitStreamAppendBytes
+ *	     BitStreamAppendStream
+ *	     BitStreamPopcount
+ *	     BitStreamPopcountRange
+ *	     BitStreamHammingDistance
+ *	     BitStreamHammingDistanceRange
+ *	     BitStreamRankXorKeySizes
+ *	     BitStreamBreakRepeatingXor
+ *	     BitStreamTranspose
+ *	     BitStreamTransposeBits8
+ *	     BitStreamTransposeBits64
+ *	     BitStreamToBitPlanes
+ *	     BitStreamFromBitPlanes
+ *	     BitStreamShiftLeft
+ *	     BitStreamShiftRight
+ *	     BitStreamShiftLeftInPlace
+ *	     BitStreamShiftRightInPlace
+ *	     BitStreamRotate
+ *	     BitStreamRotateInPlace
  *
  * Copyright (c) 2017, Makarand Kulkarni under GPLv3 License
  */
 
 #include "BitStream.h"
+#include <fcntl.h>
+#include <float.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BITSTREAM_X86	1
+#include <immintrin.h>
+#endif
+
+/**
+ * @def OWNS_ARRAY
+ * @brief true when the array of bs came from malloc and is freed with it
+ */
+#define OWNS_ARRAY(bs)	\
+	(!((bs)->flags & (BITSTREAM_BORROWED | BITSTREAM_INLINE)))
+
+/**
+ * @def CPU_SSSE3
+ * @brief cpu_features() bit for SSSE3 (pshufb, pmaddubsw)
+ */
+#define CPU_SSSE3	(1U << 0)
+
+/**
+ * @def CPU_AVX2
+ * @brief cpu_features() bit for AVX2
+ */
+#define CPU_AVX2	(1U << 1)
+
+/**
+ * @def CPU_AVX512BW
+ * @brief cpu_features() bit for AVX-512 foundation plus byte/word instructions
+ */
+#define CPU_AVX512BW	(1U << 2)
+
+/**
+ * @def CPU_POPCNT
+ * @brief cpu_features() bit for the popcnt instruction
+ */
+#define CPU_POPCNT	(1U << 3)
+
+/**
+ * @def CPU_AVX512POPCNT
+ * @brief cpu_features() bit for AVX-512 foundation plus VPOPCNTDQ
+ */
+#define CPU_AVX512POPCNT	(1U << 4)
+
+/**
+ * @def CPU_GFNI
+ * @brief cpu_features() bit for AVX2 plus the Galois field instructions
+ */
+#define CPU_GFNI	(1U << 5)
+
+/**
+ * @def CPU_PROBED
+ * @brief cpu_features() bit telling the cpu has already been probed
+ */
+#define CPU_PROBED	(1U << 31)
+
+/**
+ * @fn uint32_t cpu_features(void)
+ *
+ * @brief Returns the CPU_xxx instruction set extensions usable by the SIMD
+ * 	kernels, the cpu is probed once on first use
+ *
+ * Concurrent first calls race benignly, all of them store the same value
+ */
+static uint32_t cpu_features(void) {
+    static volatile uint32_t features = 0;
+    uint32_t f = features;
+
+    if (f == 0) {
+       f = CPU_PROBED;
+#if defined(BITSTREAM_X86)
+       __builtin_cpu_init();
+       if (__builtin_cpu_supports("ssse3"))
+          f |= CPU_SSSE3;
+       if (__builtin_cpu_supports("avx2"))
+          f |= CPU_AVX2;
+       if (__builtin_cpu_supports("avx512f") && 
+           __builtin_cpu_supports("avx512bw"))
+          f |= CPU_AVX512BW;
+       if (__builtin_cpu_supports("popcnt"))
+          f |= CPU_POPCNT;
+       if (__builtin_cpu_supports("avx512f") && 
+           __builtin_cpu_supports("avx512vpopcntdq"))
+          f |= CPU_AVX512POPCNT;
+       if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("gfni"))
+          f |= CPU_GFNI;
+#endif
+       features = f;
+    }
+    return f;
+}
 
 /**
- * @fn unsigned char xtoi(char c)
+ * @fn int xtoi(char c)
  *
  * @brief converts ascii hex character to integer value
  *
  * Modelled on lines of atoi :) 
  * @param [in] c\n
- * 	valid hex character, [A-F],[a-f],[0-9], illegal hex will throw assert!
- * 	unfortunately there are no Exceptions!
+ * 	hex character, [A-F],[a-f],[0-9]
  *
  * @returns \n
- * 	Integer value of corresponding ascii hex character
+ * 	Integer value of corresponding ascii hex character, -1 if the character
+ * 	is not a hex digit
  */
-static inline unsigned char xtoi(char c) {
-      unsigned char ll;
+static inline int xtoi(char c) {
       if (c >= '0' && c <= '9')
-             ll = c - '0';
+             return c - '0';
       else if (c >= 'a' && c <= 'f')
-            ll = c - 'a' + 10;
-      else if (c >= 'A' && c <- 'F')
-            ll = c - 'A' + 10;
-      else 
-            assert(0);
-       return ll;
+            return c - 'a' + 10;
+      else if (c >= 'A' && c <= 'F')
+            return c - 'A' + 10;
+      return (-1);
+}
+
+#if defined(BITSTREAM_X86)
+/**
+ * @fn int hexdecode_ssse3(const char *in, uint8_t *out)
+ *
+ * @brief Converts 16 hex ascii characters into 8 bytes
+ *
+ * Digits and letters are classified with unsigned range compares (a value
+ * is below n when min(value, n - 1) is the value itself), nibble pairs are
+ * merged with one multiply-add and the words packed down to bytes
+ *
+ * @returns 0 on success, -1 if any of the 16 characters is not hex
+ */
+__attribute__((target("ssse3")))
+static int hexdecode_ssse3(const char *in, uint8_t *out) {
+    __m128i v     = _mm_loadu_si128((const __m128i *)in);
+    __m128i digit = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+    __m128i alpha = _mm_sub_epi8(_mm_or_si128(v, _mm_set1_epi8(0x20)), 
+		    _mm_set1_epi8('a'));
+    __m128i isdig = _mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8(9)), 
+		    digit);
+    __m128i isalp = _mm_cmpeq_epi8(_mm_min_epu8(alpha, _mm_set1_epi8(5)), 
+		    alpha);
+    __m128i nib;
+
+    if (_mm_movemask_epi8(_mm_or_si128(isdig, isalp)) != 0xFFFF)
+       return (-1);
+
+    nib = _mm_or_si128(_mm_and_si128(isdig, digit), 
+		    _mm_and_si128(isalp, _mm_add_epi8(alpha, _mm_set1_epi8(10))));
+    nib = _mm_maddubs_epi16(nib, _mm_set1_epi16(0x0110));
+    _mm_storel_epi64((__m128i *)out, _mm_packus_epi16(nib, nib));
+
+    return 0;
+}
+
+/**
+ * @fn int hexdecode_avx2(const char *in, uint8_t *out)
+ *
+ * @brief Converts 32 hex ascii characters into 16 bytes, same scheme as 
+ * 	hexdecode_ssse3() on 256 bit registers
+ *
+ * @returns 0 on success, -1 if any of the 32 characters is not hex
+ */
+__attribute__((target("avx2")))
+static int hexdecode_avx2(const char *in, uint8_t *out) {
+    __m256i v     = _mm256_loadu_si256((const __m256i *)in);
+    __m256i digit = _mm256_sub_epi8(v, _mm256_set1_epi8('0'));
+    __m256i alpha = _mm256_sub_epi8(_mm256_or_si256(v, 
+			    _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+    __m256i isdig = _mm256_cmpeq_epi8(_mm256_min_epu8(digit, 
+			    _mm256_set1_epi8(9)), digit);
+    __m256i isalp = _mm256_cmpeq_epi8(_mm256_min_epu8(alpha, 
+			    _mm256_set1_epi8(5)), alpha);
+    __m256i nib;
+
+    if ((uint32_t)_mm256_movemask_epi8(_mm256_or_si256(isdig, isalp)) != 
+		    0xFFFFFFFFU)
+       return (-1);
+
+    nib = _mm256_or_si256(_mm256_and_si256(isdig, digit), 
+		    _mm256_and_si256(isalp, 
+			    _mm256_add_epi8(alpha, _mm256_set1_epi8(10))));
+    nib = _mm256_maddubs_epi16(nib, _mm256_set1_epi16(0x0110));
+    nib = _mm256_permute4x64_epi64(_mm256_packus_epi16(nib, nib), 0x08);
+    _mm_storeu_si128((__m128i *)out, _mm256_castsi256_si128(nib));
+
+    return 0;
 }
+#endif /* BITSTREAM_X86 */
 
 /**
- * @fn int32_t strtox(const char* in, uint8_t *out, uint16_t size)
+ * @fn int64_t strtox(const char* in, size_t len, uint8_t *out)
  *
  * @brief Convert HEX ascii string into byte array of integers, modeled on 
  * 	strtoi or strtol
- * THe string has to be terminated by '\0' character, else the result is not
- * guaranteed
- * Routine does not take care of overflow cases in output buffer if not
- * allocated properly
+ *
+ * An odd number of characters is handled as if there was a leading '0'.
+ * The bulk of the input goes through the widest SIMD decoder the cpu 
+ * supports, the remainder is converted two characters at a time
  *
  * @param [in] in\n
- * 	pointer to the string containing HEX ascii characters
+ * 	pointer to the HEX ascii characters, need not be terminated
+ * @param [in] len\n
+ * 	number of characters to convert
  * @param [out] out\n
- * 	pre-allocated byte buffer to hold the converted values
- * @param [in] size\n
- * 	size of the output buffer
+ * 	pre-allocated byte buffer of at least (len + 1) / 2 bytes
  *
- * @returns number of bytes converted (1 converted byte = 2 HEX ascii chars)
+ * @returns number of bytes converted (1 converted byte = 2 HEX ascii chars),
+ * 	-1 if the input contains a character that is not a hex digit
  */
-static inline int32_t strtox(const char* in, uint8_t *out, uint16_t size) {
-    short len = strlen(in);
-    short i = 0, j   = 0;
+static int64_t strtox(const char* in, size_t len, uint8_t *out) {
+    size_t i = 0, j = 0;
+    int ll, uu;
+#if defined(BITSTREAM_X86)
+    uint32_t cpu = cpu_features();
+#endif
 
     if (len % 2) {
+       if ((ll = xtoi(in[0])) < 0)
+          return (-1);
        i = 1;
-       out[j++] = xtoi(in[0]) ;
+       out[j++] = (uint8_t)ll;
     }
-    while (i < len) {
-        char ll = xtoi(in[i]);
-        char uu = xtoi(in[i+1]);
-        out[j++] = ll << 4 | uu;
 
-        if (j >= size) 
-            return (-1);
+#if defined(BITSTREAM_X86)
+    if (cpu & CPU_AVX2) {
+       for (; i + 32 <= len; i += 32, j += 16)
+          if (hexdecode_avx2(in + i, out + j))
+             return (-1);
+    }
+    if (cpu & CPU_SSSE3) {
+       for (; i + 16 <= len; i += 16, j += 8)
+          if (hexdecode_ssse3(in + i, out + j))
+             return (-1);
+    }
+#endif
+
+    while (i < len) {
+        ll = xtoi(in[i]);
+        uu = xtoi(in[i+1]);
+        if ((ll | uu) < 0)
+           return (-1);
+        out[j++] = (uint8_t)(ll << 4 | uu);
         i += 2;
     }
-    return j;
+    return (int64_t)j;
 }
 
 /**
- * @ingroup Bitstream
- * @fn uint16_t BitStreamGetSizeBits(BitStream* bs)
- * @brief Get size in bits of the BitStream object 
+ * @var base64_alphabet
+ * @brief RFC 4648 standard Base64 alphabet
+ */
+static const char base64_alphabet[] = 
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+#if defined(BITSTREAM_X86)
+/**
+ * @fn __m256i base64_sextets_avx2(__m256i in)
  *
- * @param [in] *bs\n
- * 	Pointer to bitstream object whose size is to be retrieved
- * @returns length in BITs of the bit stream
+ * @brief Splits each 3 byte group in the low 12 bytes of every 128 bit lane
+ * 	into four 6 bit values, one per output byte
+ *
+ * The groups are first spread to 4 bytes in {b1, b0, b2, b1} order, after
+ * which multiplies by powers of two move each sextet to its own byte
+ * (W. Mula, "Base64 encoding with SIMD instructions")
  */
-inline uint16_t BitStreamGetSizeBits(BitStream *bs) {
-   return bs ? bs->nbits : 0;
-}   
+__attribute__((target("avx2")))
+static inline __m256i base64_sextets_avx2(__m256i in) {
+    __m256i t0, t1;
+
+    in = _mm256_shuffle_epi8(in, _mm256_setr_epi8(
+		    1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+		    1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+    t0 = _mm256_mulhi_epu16(_mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00)),
+		    _mm256_set1_epi32(0x04000040));
+    t1 = _mm256_mullo_epi16(_mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0)),
+		    _mm256_set1_epi32(0x01000010));
+    return _mm256_or_si256(t0, t1);
+}
 
 /**
- * @ingroup Bitstream
- * @fn uint8_t* BitStreamGetArray(BitStream* bs)
- * @brief Get the pointer to array holding bitstream
+ * @fn __m256i base64_ascii_avx2(__m256i sextets)
  *
- * @param [in] *bs\n
- * 	Pointer to bitstream object whose size is to be retrieved
- * @returns pointer to array if valid bitstream, else NULL
+ * @brief Maps 6 bit values to the Base64 alphabet
+ *
+ * Each value is reduced to one of 14 ranges, whose offset to the ascii
+ * character is then fetched with a pshufb
  */
-inline uint8_t* BitStreamGetArray(BitStream *bs) {
-   return bs ? bs->array : NULL;
+__attribute__((target("avx2")))
+static inline __m256i base64_ascii_avx2(__m256i v) {
+    const __m256i shift = _mm256_setr_epi8(
+		    'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+		    '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+		    '/' - 63, 'A', 0, 0,
+		    'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+		    '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+		    '/' - 63, 'A', 0, 0);
+    __m256i r = _mm256_subs_epu8(v, _mm256_set1_epi8(51));
+    __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), v);
+
+    r = _mm256_or_si256(r, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+    return _mm256_add_epi8(v, _mm256_shuffle_epi8(shift, r));
 }
- 
+
 /**
- * @ingroup Bitstream
- * @fn BitStream* BitStreamCreate(uint16_t nbits)
- * @brief Creates a object of type BitStream and allocates space to hold nbits
+ * @fn size_t base64encode_avx2(const uint8_t *in, size_t n, char *out)
  *
- * @param [in] nbits\n
- * 	number of bits to hold in bit stream. If nbits is zero, just a container
- * 	object is created and new buffer can be added with BitStreamBuffer()
- * @returns pointer to newly created bit stream object, NULL on failure
+ * @brief Encodes 24 input bytes into 32 characters per iteration
+ *
+ * Each lane is loaded with 16 bytes of which 12 are used, so the loop stops
+ * while at least 4 bytes of slack remain past the block
+ *
+ * @returns number of input bytes consumed, a multiple of 24
  */
-BitStream* BitStreamCreate(uint16_t nbits) {
-   
-   BitStream *bs = (BitStream *)malloc(sizeof(BitStream));
-   if (bs != NULL) { 
+__attribute__((target("avx2")))
+static size_t base64encode_avx2(const uint8_t *in, size_t n, char *out) {
+    size_t i = 0;
+    __m256i v;
 
-      if (nbits) {
-        bs->array = (uint8_t*)malloc((nbits + BITS_PER_BYTE - 1)/BITS_PER_BYTE);
-        if (NULL == bs->array) {
-          free(bs);
-          bs = NULL;
-        } else {
-	  memset(bs->array, (nbits + BITS_PER_BYTE - 1)/BITS_PER_BYTE, '\0');
-        }
-      } else {
-	 bs->array = NULL;
-      }
-   }
-   bs->nbits = nbits;
+    for (; i + 28 <= n; i += 24, out += 32) {
+       v = _mm256_inserti128_si256(_mm256_castsi128_si256(
+			       _mm_loadu_si128((const __m128i *)(in + i))),
+		       _mm_loadu_si128((const __m128i *)(in + i + 12)), 1);
+       v = base64_ascii_avx2(base64_sextets_avx2(v));
+       _mm256_storeu_si256((__m256i *)out, v);
+    }
+    return i;
+}
 
-   return bs;
+/**
+ * @fn size_t base64encode_avx512(const uint8_t *in, size_t n, char *out)
+ *
+ * @brief Encodes 48 input bytes into 64 characters per iteration, same
+ * 	scheme as base64encode_avx2() with a dword permute spreading the 4
+ * 	groups of 12 bytes across the 128 bit lanes
+ *
+ * @returns number of input bytes consumed, a multiple of 48
+ */
+__attribute__((target("avx512f,avx512bw")))
+static size_t base64encode_avx512(const uint8_t *in, size_t n, char *out) {
+    const __m512i spread = _mm512_setr_epi32(0, 1, 2, 3, 3, 4, 5, 6,
+		    6, 7, 8, 9, 9, 10, 11, 12);
+    const __m512i shift = _mm512_broadcast_i32x4(_mm_setr_epi8(
+		    'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+		    '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+		    '/' - 63, 'A', 0, 0));
+    const __m512i order = _mm512_broadcast_i32x4(_mm_setr_epi8(
+		    1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+    size_t i = 0;
+    __m512i v, t0, t1, r;
+    __mmask64 less;
+
+    for (; i + 48 <= n; i += 48, out += 64) {
+       v  = _mm512_maskz_loadu_epi32(0x0FFF, in + i);
+       v  = _mm512_shuffle_epi8(_mm512_permutexvar_epi32(spread, v), order);
+       t0 = _mm512_mulhi_epu16(_mm512_and_si512(v, 
+			       _mm512_set1_epi32(0x0fc0fc00)), 
+		       _mm512_set1_epi32(0x04000040));
+       t1 = _mm512_mullo_epi16(_mm512_and_si512(v, 
+			       _mm512_set1_epi32(0x003f03f0)),
+		       _mm512_set1_epi32(0x01000010));
+       v  = _mm512_or_si512(t0, t1);
+       r  = _mm512_subs_epu8(v, _mm512_set1_epi8(51));
+       less = _mm512_cmplt_epu8_mask(v, _mm512_set1_epi8(26));
+       r  = _mm512_mask_mov_epi8(r, less, _mm512_set1_epi8(13));
+       _mm512_storeu_si512(out, _mm512_add_epi8(v, _mm512_shuffle_epi8(shift, 
+				       r)));
+    }
+    return i;
 }
+#endif /* BITSTREAM_X86 */
 
 /**
- * @ingroup Bitstream
- * @fn BitStream* BitStreamCreateHex(const char* s)
- * @brief Creates a object of type BitStream and allocates space to hold the
- * 	HEX byte array passed as argument. The hex byte array in ASCII format
- * 	is converted to HEX byte array, for instance, "deadbeef" (len 8 bytes)
- * 	is stored as 0xdeadbeef (length 4 bytes)
+ * @fn size_t base64encode(const uint8_t *in, size_t n, char *out)
  *
- * @param [in] s\n
- * 	HEX buffer string that is filled in the newly allocated BitStream
- * @returns pointer to newly created bit stream object, NULL on failure
+ * @brief Encodes n bytes as RFC 4648 Base64 with '=' padding
+ *
+ * The bulk goes through the widest SIMD kernel the cpu supports, the rest
+ * is converted 3 bytes to 4 characters per step through the alphabet table.
+ * The output is not NULL terminated
+ *
+ * @param [in] in\n
+ * 	bytes to encode
+ * @param [in] n\n
+ * 	number of bytes to encode
+ * @param [out] out\n
+ * 	buffer of at least BASE64_ENCODED_SIZE(n) characters
+ * @returns number of characters written
  */
-BitStream* BitStreamCreateHex(const char* s) {
-   BitStream* bs = NULL;
+static size_t base64encode(const uint8_t *in, size_t n, char *out) {
+    size_t   i = 0;
+    char     *o = out;
+    uint32_t w;
+#if defined(BITSTREAM_X86)
+    uint32_t cpu = cpu_features();
 
-   bs = BitStreamCreate(0); /* Empty container */
+    if (cpu & CPU_AVX512BW) {
+       i = base64encode_avx512(in, n, o);
+       o += i / 3 * 4;
+    }
+    if (cpu & CPU_AVX2) {
+       w  = base64encode_avx2(in + i, n - i, o);
+       i += w;
+       o += w / 3 * 4;
+    }
+#endif
 
-   if (BitStreamCopyHex(bs, s) <= 0) {
-	   BitStreamDelete(bs);
-	   bs = NULL;
-   }
-   return bs;
+    for (; i + 3 <= n; i += 3, o += 4) {
+       w = (uint32_t)in[i] << 16 | (uint32_t)in[i + 1] << 8 | in[i + 2];
+       o[0] = base64_alphabet[(w >> 18) & 0x3F];
+       o[1] = base64_alphabet[(w >> 12) & 0x3F];
+       o[2] = base64_alphabet[(w >> 6) & 0x3F];
+       o[3] = base64_alphabet[w & 0x3F];
+    }
+
+    if (i < n) {
+       w = (uint32_t)in[i] << 16 | (i + 1 < n ? (uint32_t)in[i + 1] << 8 : 0);
+       o[0] = base64_alphabet[(w >> 18) & 0x3F];
+       o[1] = base64_alphabet[(w >> 12) & 0x3F];
+       o[2] = i + 1 < n ? base64_alphabet[(w >> 6) & 0x3F] : '=';
+       o[3] = '=';
+       o += 4;
+    }
+    return (size_t)(o - out);
 }
 
 /**
- * @ingroup Bitstream
- * @fn BitStream* BitStreamCreateAscii(const char* s)
- * @brief Creates a object of type BitStream and allocates space to hold the
- * 	ASCII byte array passed as argument
+ * @fn size_t base64encode_stream(BitStream *bs, char *out)
  *
- * @param [in] s\n
- * 	ASCII buffer string that is filled in the newly allocated BitStream
- * @returns pointer to newly created bit stream object, NULL on failure
+ * @brief Encodes the bytes of a bit stream, unused bits of a trailing 
+ * 	partial byte are encoded as zero
+ *
+ * @returns number of characters written
  */
-BitStream* BitStreamCreateAscii(const char* s) {
-   BitStream* bs = NULL;
+static size_t base64encode_stream(BitStream *bs, char *out) {
+    size_t   nbytes = BITS_TO_BYTES(bs->nbits);
+    uint32_t tail   = bs->nbits % BITS_PER_BYTE;
+    uint8_t  last[3];
+    size_t   head, len;
 
-   bs = BitStreamCreate(0); /* Empty container */
+    if (tail == 0)
+       return base64encode(bs->array, nbytes, out);
 
-   if (BitStreamCopyAscii(bs, s) <= 0) {
-	   BitStreamDelete(bs);
-	   bs = NULL;
-   }
-   return bs;
+    /* re-encode the final group from a copy with the spare bits cleared */
+    head = (nbytes - 1) / 3 * 3;
+    len  = base64encode(bs->array, head, out);
+    memcpy(last, bs->array + head, nbytes - head);
+    last[nbytes - head - 1] &= 0xFF << (BITS_PER_BYTE - tail);
+
+    return len + base64encode(last, nbytes - head, out + len);
 }
+
 /**
- * @ingroup Bitstream
+ * @fn int base64value(char c, uint32_t flags)
  *
- * @fn BitStreamRealloc(BitStream* bs, uint8_t buffer, uint16_t nbits) 
+ * @brief Maps a Base64 character of the selected alphabet to its 6 bit value
  *
- * @brief Reinitialize the BitStream buffer to a new one
- * 	Routine will create a new one with number of bits if not provided
- * 	else use the buffer provided as param
- * 	In case there's no new buffer provided, it calls realloc() to adjust
- * 	the size of the allocated buffer
- * @param [in] bs\n
- * 	BitStream object to operate on
- * @param [in] *buffer\n
- * 	Buffer pointer to use for reallocation, if NULL, either a new one or 
- * 	reallocated one will be used
- * @param [in] nbits\n
- * 	size in bits of the new buffer
- * @returns none
+ * @returns value 0..63, -1 if c is not part of the alphabet
  */
-void BitStreamRealloc(BitStream* bs, uint8_t *buffer, uint16_t nbits) {
-   if (bs) { 
-      if (bs->array) {
-         if (buffer) {
-	    free (bs->array);
-	    bs->array = buffer;
-	 } else {
-            if (nbits) {
-               bs->array = (uint8_t *)realloc(bs->array, 
-			       (nbits + BITS_PER_BYTE - 1)/ BITS_PER_BYTE);
-	    } else {
-	       bs->array = NULL;
-	    }
-	 }
-      } else {
-	 bs->array = buffer ? buffer : (uint8_t *)
-		 malloc((nbits + BITS_PER_BYTE - 1)/ BITS_PER_BYTE);
-      }
-      bs->nbits = nbits;
-   }
+static inline int base64value(char c, uint32_t flags) {
+    if (c >= 'A' && c <= 'Z')
+       return c - 'A';
+    if (c >= 'a' && c <= 'z')
+       return c - 'a' + 26;
+    if (c >= '0' && c <= '9')
+       return c - '0' + 52;
+    if (c == ((flags & BASE64_URLSAFE) ? '-' : '+'))
+       return 62;
+    if (c == ((flags & BASE64_URLSAFE) ? '_' : '/'))
+       return 63;
+    return (-1);
 }
 
+#if defined(BITSTREAM_X86)
+/**
+ * @fn int base64decode_ssse3(const char *in, uint8_t *out, char c62,\n
+ * 	char c63)
+ *
+ * @brief Converts 16 Base64 characters into 12 bytes
+ *
+ * Characters are classified by unsigned range compares against the letter
+ * and digit ranges and equality with the two symbols of the alphabet, each
+ * class adding its own offset. Sextets are then merged pairwise with
+ * pmaddubsw and pmaddwd and the 3 byte groups gathered with a pshufb
+ *
+ * @returns 0 on success, -1 if any of the characters is outside the 
+ * 	alphabet (padding and white space included)
+ */
+__attribute__((target("ssse3")))
+static int base64decode_ssse3(const char *in, uint8_t *out, char c62, 
+		char c63) {
+    __m128i v  = _mm_loadu_si128((const __m128i *)in);
+    __m128i up = _mm_sub_epi8(v, _mm_set1_epi8('A'));
+    __m128i lo = _mm_sub_epi8(v, _mm_set1_epi8('a'));
+    __m128i dg = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+    __m128i isup = _mm_cmpeq_epi8(_mm_min_epu8(up, _mm_set1_epi8(25)), up);
+    __m128i islo = _mm_cmpeq_epi8(_mm_min_epu8(lo, _mm_set1_epi8(25)), lo);
+    __m128i isdg = _mm_cmpeq_epi8(_mm_min_epu8(dg, _mm_set1_epi8(9)), dg);
+    __m128i is62 = _mm_cmpeq_epi8(v, _mm_set1_epi8(c62));
+    __m128i is63 = _mm_cmpeq_epi8(v, _mm_set1_epi8(c63));
+    __m128i s;
+    uint32_t tail;
+
+    if (_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(isup, islo), 
+			    _mm_or_si128(isdg, _mm_or_si128(is62, is63)))) 
+		    != 0xFFFF)
+       return (-1);
+
+    s = _mm_or_si128(_mm_and_si128(isup, up), 
+		    _mm_and_si128(islo, _mm_add_epi8(lo, _mm_set1_epi8(26))));
+    s = _mm_or_si128(s, _mm_and_si128(isdg, 
+			    _mm_add_epi8(dg, _mm_set1_epi8(52))));
+    s = _mm_or_si128(s, _mm_and_si128(is62, _mm_set1_epi8(62)));
+    s = _mm_or_si128(s, _mm_and_si128(is63, _mm_set1_epi8(63)));
+
+    s = _mm_maddubs_epi16(s, _mm_set1_epi32(0x01400140));
+    s = _mm_madd_epi16(s, _mm_set1_epi32(0x00011000));
+    s = _mm_shuffle_epi8(s, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 
+			    14, 13, 12, -1, -1, -1, -1));
+    _mm_storel_epi64((__m128i *)out, s);
+    tail = (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(s, 8));
+    memcpy(out + 8, &tail, sizeof(tail));
+
+    return 0;
+}
 
 /**
- * @ingroup BitStream
- * @fn void BitStreamDelete(BitStream* bs)
+ * @fn int base64decode_avx2(const char *in, uint8_t *out, char c62,\n
+ * 	char c63)
  *
- * @brief Deletes the bit stream object, frees the memory holding bits
+ * @brief Converts 32 Base64 characters into 24 bytes, same scheme as
+ * 	base64decode_ssse3() with a cross lane dword permute joining the two
+ * 	12 byte halves
  *
- * @param [in] bs\n
- * 	pointer to bit stream object
+ * @returns 0 on success, -1 if any of the characters is outside the 
+ * 	alphabet (padding and white space included)
+ */
+__attribute__((target("avx2")))
+static int base64decode_avx2(const char *in, uint8_t *out, char c62, 
+		char c63) {
+    __m256i v  = _mm256_loadu_si256((const __m256i *)in);
+    __m256i up = _mm256_sub_epi8(v, _mm256_set1_epi8('A'));
+    __m256i lo = _mm256_sub_epi8(v, _mm256_set1_epi8('a'));
+    __m256i dg = _mm256_sub_epi8(v, _mm256_set1_epi8('0'));
+    __m256i isup = _mm256_cmpeq_epi8(_mm256_min_epu8(up, 
+			    _mm256_set1_epi8(25)), up);
+    __m256i islo = _mm256_cmpeq_epi8(_mm256_min_epu8(lo, 
+			    _mm256_set1_epi8(25)), lo);
+    __m256i isdg = _mm256_cmpeq_epi8(_mm256_min_epu8(dg, 
+			    _mm256_set1_epi8(9)), dg);
+    __m256i is62 = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(c62));
+    __m256i is63 = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(c63));
+    __m256i s;
+
+    if ((uint32_t)_mm256_movemask_epi8(_mm256_or_si256(
+			    _mm256_or_si256(isup, islo), _mm256_or_si256(isdg, 
+				    _mm256_or_si256(is62, is63)))) != 0xFFFFFFFFU)
+       return (-1);
+
+    s = _mm256_or_si256(_mm256_and_si256(isup, up), _mm256_and_si256(islo, 
+			    _mm256_add_epi8(lo, _mm256_set1_epi8(26))));
+    s = _mm256_or_si256(s, _mm256_and_si256(isdg, 
+			    _mm256_add_epi8(dg, _mm256_set1_epi8(52))));
+    s = _mm256_or_si256(s, _mm256_and_si256(is62, _mm256_set1_epi8(62)));
+    s = _mm256_or_si256(s, _mm256_and_si256(is63, _mm256_set1_epi8(63)));
+
+    s = _mm256_maddubs_epi16(s, _mm256_set1_epi32(0x01400140));
+    s = _mm256_madd_epi16(s, _mm256_set1_epi32(0x00011000));
+    s = _mm256_shuffle_epi8(s, _mm256_setr_epi8(
+			    2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+			    2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+    s = _mm256_permutevar8x32_epi32(s, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 
+			    7, 7));
+    _mm_storeu_si128((__m128i *)out, _mm256_castsi256_si128(s));
+    _mm_storel_epi64((__m128i *)(out + 16), _mm256_extracti128_si256(s, 1));
+
+    return 0;
+}
+#endif /* BITSTREAM_X86 */
+
+/**
+ * @fn int64_t base64decode(Base64Decoder *st, const char *in, size_t len,\n
+ * 	uint8_t *out, size_t *errpos)
+ *
+ * @brief Decodes Base64 characters into bytes, resuming from and leaving a
+ * 	partial quantum in the decoder state
+ *
+ * Whenever the decoder sits on a 4 character boundary it tries the widest
+ * SIMD kernel the cpu supports. A block the kernel rejects (padding, white
+ * space, invalid characters) is handled by the scalar decoder up to its 
+ * first offending character and on to the next 4 character boundary.
+ * Padding is optional, but when present it has to complete the final 
+ * quantum and may only be followed by white space (with BASE64_SKIPSPACE)
+ *
+ * @param [in,out] st\n
+ * 	decoder state, see Base64DecoderInit
+ * @param [in] in\n
+ * 	characters to decode, need not be terminated
+ * @param [in] len\n
+ * 	number of characters
+ * @param [out] out\n
+ * 	buffer of at least BASE64_DECODED_SIZE(len + 3) bytes
+ * @param [out] errpos\n
+ * 	offset, counted from the first character given to the decoder, of 
+ * 	the first invalid character on error; may be NULL
+ * @returns number of bytes decoded, -1 on error
+ */
+static int64_t base64decode(Base64Decoder *st, const char *in, size_t len, 
+		uint8_t *out, size_t *errpos) {
+    size_t   i = 0, j = 0, stop;
+    uint32_t acc = st->acc, n = st->n, pad = st->pad;
+    uint32_t flags = st->flags;
+    int      v;
+#if defined(BITSTREAM_X86)
+    uint32_t cpu = cpu_features();
+    char     c62 = (flags & BASE64_URLSAFE) ? '-' : '+';
+    char     c63 = (flags & BASE64_URLSAFE) ? '_' : '/';
+#endif
+
+    while (i < len) {
+       stop = len;
+#if defined(BITSTREAM_X86)
+       if (n == 0 && pad == 0) {
+          if (cpu & CPU_AVX2) {
+             while (i + 32 <= len && base64decode_avx2(in + i, out + j, 
+				     c62, c63) == 0) {
+                i += 32;
+                j += 24;
+             }
+          }
+          if (cpu & CPU_SSSE3) {
+             while (i + 16 <= len && base64decode_ssse3(in + i, out + j, 
+				     c62, c63) == 0) {
+                i += 16;
+                j += 12;
+             }
+          }
+          /* kernels stopped on a rejected block, go scalar past it */
+          stop = MIN(i + 32, len);
+       } else {
+          /* finish the pending quantum, then back to the kernels */
+          stop = i;
+       }
+#endif
+       for (; i < len && (i < stop || n != 0); i++) {
+          v = base64value(in[i], flags);
+          if (v >= 0 && pad == 0) {
+             acc = acc << 6 | (uint32_t)v;
+             if (++n == 4) {
+                out[j++] = (uint8_t)(acc >> 16);
+                out[j++] = (uint8_t)(acc >> 8);
+                out[j++] = (uint8_t)acc;
+                n = 0;
+             }
+          } else if (in[i] == '=' && n >= 2 && n + pad < 4) {
+             pad++;
+          } else if ((flags & BASE64_SKIPSPACE) && 
+		     isspace((unsigned char)in[i])) {
+             continue;
+          } else {
+             if (errpos)
+                *errpos = st->offset + i;
+             return (-1);
+          }
+       }
+    }
+
+    st->acc = acc;
+    st->n   = n;
+    st->pad = pad;
+    st->offset += len;
+
+    return (int64_t)j;
+}
+
+/**
+ * @fn int64_t base64final(Base64Decoder *st, uint8_t *out, size_t *errpos)
+ *
+ * @brief Flushes the partial quantum left in the decoder state, unpadded
+ * 	input may end with 2 or 3 characters of a quantum
+ *
+ * @returns number of bytes decoded (0 to 2), -1 if the input ended with a
+ * 	single character or incomplete padding, errpos is then set to the 
+ * 	total input length
+ */
+static int64_t base64final(Base64Decoder *st, uint8_t *out, size_t *errpos) {
+    int64_t j = 0;
+
+    if (st->n == 1 || (st->pad && st->n + st->pad != 4)) {
+       if (errpos)
+          *errpos = st->offset;
+       return (-1);
+    }
+    if (st->n >= 2)
+       out[j++] = (uint8_t)(st->acc >> (st->n == 2 ? 4 : 10));
+    if (st->n == 3)
+       out[j++] = (uint8_t)(st->acc >> 2);
+
+    st->acc = 0;
+    st->n   = 0;
+    st->pad = 0;
+
+    return j;
+}
+
+/**
+ * @fn uint64_t load64be(const uint8_t *p)
+ *
+ * @brief Unaligned load of 8 bytes in network (MSB first) order
+ *
+ * @param [in] p\n
+ * 	pointer to first of the 8 bytes to load, need not be aligned
+ * @returns 64 bit word with p[0] in the most significant byte
+ */
+static inline uint64_t load64be(const uint8_t *p) {
+    uint64_t w;
+
+    memcpy(&w, p, sizeof(w));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    w = __builtin_bswap64(w);
+#endif
+    return w;
+}
+
+/**
+ * @fn void store64be(uint8_t *p, uint64_t w)
+ *
+ * @brief Unaligned store of 64 bit word in network (MSB first) order
+ *
+ * @param [out] p\n
+ * 	pointer to 8 byte destination, need not be aligned
+ * @param [in] w\n
+ * 	word to store, most significant byte goes to p[0]
  * @returns none
  */
-void BitStreamDelete(BitStream* bs) {
-   if (bs != NULL) {
-      if (bs->array != NULL) {
-         free(bs->array);
-      }
-      free(bs);
+static inline void store64be(uint8_t *p, uint64_t w) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    w = __builtin_bswap64(w);
+#endif
+    memcpy(p, &w, sizeof(w));
+}
+
+/**
+ * @fn uint64_t load64le(const uint8_t *p)
+ *
+ * @brief Unaligned load of 8 bytes with p[0] in the least significant byte
+ */
+static inline uint64_t load64le(const uint8_t *p) {
+    uint64_t w;
+
+    memcpy(&w, p, sizeof(w));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    w = __builtin_bswap64(w);
+#endif
+    return w;
+}
+
+/**
+ * @fn void store64le(uint8_t *p, uint64_t w)
+ *
+ * @brief Unaligned store of 64 bit word with least significant byte in p[0]
+ */
+static inline void store64le(uint8_t *p, uint64_t w) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    w = __builtin_bswap64(w);
+#endif
+    memcpy(p, &w, sizeof(w));
+}
+
+/**
+ * @fn uint8_t bitfetch8(const uint8_t *a, uint64_t offset, uint32_t nbits)
+ *
+ * @brief Fetches up to 8 bits from byte array at bit offset, the bits are
+ * 	returned right aligned (same convention as BitStreamGetByte)
+ *
+ * No bounds checking, the caller guarantees the bits exist in the array
+ */
+static inline uint8_t bitfetch8(const uint8_t *a, uint64_t offset, 
+		uint32_t nbits) {
+    DECL_BYTE_OFFSET(i);
+    DECL_BITS_OFFSET(j);
+    uint32_t v = (uint32_t)a[i] << BITS_PER_BYTE;
+
+    if (j + nbits > BITS_PER_BYTE)
+       v |= a[i + 1];
+
+    return (uint8_t)((v >> (2 * BITS_PER_BYTE - j - nbits)) & 
+		    ((1U << nbits) - 1));
+}
+
+/**
+ * @fn void bitstore8(uint8_t *a, uint64_t offset, uint8_t v, uint32_t nbits)
+ *
+ * @brief Stores low nbits (up to 8) of v in byte array at bit offset in 
+ * 	network order, bits around the destination range are preserved
+ *
+ * No bounds checking, the caller guarantees the bits exist in the array
+ */
+static inline void bitstore8(uint8_t *a, uint64_t offset, uint8_t v, 
+		uint32_t nbits) {
+    DECL_BYTE_OFFSET(i);
+    DECL_BITS_OFFSET(j);
+    uint32_t shift = 2 * BITS_PER_BYTE - j - nbits;
+    uint32_t mask  = ((1U << nbits) - 1) << shift;
+    uint32_t bits  = ((uint32_t)v << shift) & mask;
+
+    a[i] = (a[i] & ~(mask >> BITS_PER_BYTE)) | (bits >> BITS_PER_BYTE);
+    if (j + nbits > BITS_PER_BYTE)
+       a[i + 1] = (a[i + 1] & ~mask) | (bits & 0xFF);
+}
+
+#if defined(BITSTREAM_X86)
+/**
+ * @fn static size_t funnel_avx2(uint8_t *dst, const uint8_t *src, size_t n,
+ * 	uint32_t shift)
+ *
+ * @brief Sets dst[i] = src[i] << shift | src[i + 1] >> (8 - shift), 32 
+ * 	bytes at a time going up, shift being 1 to 7
+ *
+ * Reads src[0] to src[n], safe in place when dst is not above src
+ *
+ * @returns number of bytes written, a multiple of 32
+ */
+__attribute__((target("avx2")))
+static size_t funnel_avx2(uint8_t *dst, const uint8_t *src, size_t n, 
+		uint32_t shift) {
+    const __m128i sl = _mm_cvtsi32_si128((int)shift);
+    const __m128i sr = _mm_cvtsi32_si128((int)(BITS_PER_BYTE - shift));
+    const __m256i hi = _mm256_set1_epi8((char)(0xFF << shift));
+    const __m256i lo = _mm256_set1_epi8((char)(0xFF >> (BITS_PER_BYTE - shift)));
+    __m256i a, b;
+    size_t  i;
+
+    for (i = 0; i + 32 <= n; i += 32) {
+       a = _mm256_loadu_si256((const __m256i *)(src + i));
+       b = _mm256_loadu_si256((const __m256i *)(src + i + 1));
+       _mm256_storeu_si256((__m256i *)(dst + i), 
+		       _mm256_or_si256(_mm256_and_si256(_mm256_sll_epi16(a, sl), hi),
+			       _mm256_and_si256(_mm256_srl_epi16(b, sr), lo)));
+    }
+    return i;
+}
+
+/**
+ * @fn static size_t funnelback_avx2(uint8_t *dst, const uint8_t *src, 
+ * 	size_t n, uint32_t shift)
+ *
+ * @brief Same as funnel_avx2() going down from dst[n - 1], safe in place 
+ * 	when dst is not below src
+ *
+ * src[i + 1] comes from the previous (higher) load rather than memory, 
+ * which may already hold output
+ *
+ * @returns number of bytes written at the top of dst, a multiple of 32
+ */
+__attribute__((target("avx2")))
+static size_t funnelback_avx2(uint8_t *dst, const uint8_t *src, size_t n, 
+		uint32_t shift) {
+    const __m128i sl = _mm_cvtsi32_si128((int)shift);
+    const __m128i sr = _mm_cvtsi32_si128((int)(BITS_PER_BYTE - shift));
+    const __m256i hi = _mm256_set1_epi8((char)(0xFF << shift));
+    const __m256i lo = _mm256_set1_epi8((char)(0xFF >> (BITS_PER_BYTE - shift)));
+    __m256i next = _mm256_set1_epi8((char)src[n]);
+    __m256i a, b;
+    size_t  i;
+
+    for (i = n; i >= 32; i -= 32) {
+       a = _mm256_loadu_si256((const __m256i *)(src + i - 32));
+       b = _mm256_alignr_epi8(_mm256_permute2x128_si256(a, next, 0x21), a, 1);
+       _mm256_storeu_si256((__m256i *)(dst + i - 32), 
+		       _mm256_or_si256(_mm256_and_si256(_mm256_sll_epi16(a, sl), hi),
+			       _mm256_and_si256(_mm256_srl_epi16(b, sr), lo)));
+       next = a;
+    }
+    return n - i;
+}
+#endif
+
+/**
+ * @fn void bitcopy(uint8_t *dst, uint64_t doff, const uint8_t *src,
+ * 	uint64_t soff, uint64_t nbits)
+ *
+ * @brief Copies nbits from any bit offset of src to any bit offset of dst
+ *
+ * Destination is first brought to a byte boundary, after which either the
+ * source is byte aligned too and the bulk is a plain memmove(), or the bulk
+ * is produced 64 bits at a time by funnel merging an unaligned big endian
+ * word load with the next source byte. Bits outside the destination range
+ * are preserved. Source and destination ranges may overlap when the 
+ * destination starts at or before the source (bit position doff <= soff in
+ * the same array, whatever the alignments): every step reads the source 
+ * ahead of where it writes. Moves to a later position need bitcopyback().
+ *
+ * @param [out] dst\n
+ * 	destination byte array
+ * @param [in] doff\n
+ * 	bit offset into destination
+ * @param [in] src\n
+ * 	source byte array
+ * @param [in] soff\n
+ * 	bit offset into source
+ * @param [in] nbits\n
+ * 	number of bits to copy
+ * @returns none
+ */
+static void bitcopy(uint8_t *dst, uint64_t doff, const uint8_t *src, 
+		uint64_t soff, uint64_t nbits) {
+    uint32_t shift;
+    uint32_t head = doff % BITS_PER_BYTE;
+
+    if (nbits == 0)
+       return;
+
+    if (head) {
+       head = MIN(BITS_PER_BYTE - head, nbits);
+       bitstore8(dst, doff, bitfetch8(src, soff, head), head);
+       doff  += head;
+       soff  += head;
+       nbits -= head;
+    }
+
+    dst  += doff / BITS_PER_BYTE;
+    src  += soff / BITS_PER_BYTE;
+    shift = soff % BITS_PER_BYTE;
+
+    if (shift == 0) {
+       memmove(dst, src, nbits / BITS_PER_BYTE);
+       dst   += nbits / BITS_PER_BYTE;
+       src   += nbits / BITS_PER_BYTE;
+    } else {
+#if defined(BITSTREAM_X86)
+       if (nbits >= 256 && (cpu_features() & CPU_AVX2)) {
+          size_t done = funnel_avx2(dst, src, nbits / BITS_PER_BYTE, shift);
+
+          dst   += done;
+          src   += done;
+          nbits -= (uint64_t)done * BITS_PER_BYTE;
+       }
+#endif
+       /* bits [shift, shift + 64) of src span 9 bytes, all inside the range */
+       while (nbits >= 64) {
+          store64be(dst, (load64be(src) << shift) | 
+			  (src[8] >> (BITS_PER_BYTE - shift)));
+          dst   += 8;
+          src   += 8;
+          nbits -= 64;
+       }
+       while (nbits >= BITS_PER_BYTE) {
+          *dst++ = (uint8_t)((src[0] << shift) | 
+			  (src[1] >> (BITS_PER_BYTE - shift)));
+          src++;
+          nbits -= BITS_PER_BYTE;
+       }
+    }
+
+    nbits %= BITS_PER_BYTE;
+    if (nbits)
+       bitstore8(dst, 0, bitfetch8(src, shift, nbits), nbits);
+}
+
+/**
+ * @fn void bitcopyback(uint8_t *dst, uint64_t doff, const uint8_t *src,
+ * 	uint64_t soff, uint64_t nbits)
+ *
+ * @brief bitcopy() working down from the end of the range, for moves to a
+ * 	higher offset of the same array
+ *
+ * Each source byte is carried over from the previous (higher) step rather
+ * than read again, the copy may have overwritten it already
+ *
+ * @returns none
+ */
+static void bitcopyback(uint8_t *dst, uint64_t doff, const uint8_t *src, 
+		uint64_t soff, uint64_t nbits) {
+    uint64_t dend = doff + nbits;
+    uint64_t send = soff + nbits;
+    uint32_t tail = MIN(dend % BITS_PER_BYTE, nbits);
+    uint32_t shift;
+    uint64_t w;
+    uint8_t  *d, carry, v;
+    const uint8_t *s;
+    size_t   n;
+
+    if (tail) {
+       bitstore8(dst, dend - tail, bitfetch8(src, send - tail, tail), tail);
+       send  -= tail;
+       dend  -= tail;
+       nbits -= tail;
+    }
+
+    /* n whole bytes end at dend, their bits start at bit shift of s */
+    n     = nbits / BITS_PER_BYTE;
+    d     = dst + dend / BITS_PER_BYTE - n;
+    s     = src + (send - (uint64_t)n * BITS_PER_BYTE) / BITS_PER_BYTE;
+    shift = send % BITS_PER_BYTE;
+
+    if (shift == 0) {
+       memmove(d, s, n);
+    } else if (n) {
+       carry = s[n];
+#if defined(BITSTREAM_X86)
+       if (n >= 32 && (cpu_features() & CPU_AVX2)) {
+          carry = s[n % 32];
+          n    -= funnelback_avx2(d + n % 32, s + n % 32, n - n % 32, shift);
+       }
+#endif
+       while (n >= 8) {
+          n    -= 8;
+          w     = load64be(s + n);
+          store64be(d + n, (w << shift) | (carry >> (BITS_PER_BYTE - shift)));
+          carry = (uint8_t)(w >> 56);
+       }
+       while (n) {
+          v     = s[--n];
+          d[n]  = (uint8_t)((v << shift) | (carry >> (BITS_PER_BYTE - shift)));
+          carry = v;
+       }
+    }
+
+    nbits %= BITS_PER_BYTE;
+    if (nbits)
+       bitstore8(dst, doff, bitfetch8(src, soff, nbits), nbits);
+}
+
+/**
+ * @ingroup Bitstream
+ * @fn uint64_t BitStreamGetSizeBits(BitStream* bs)
+ * @brief Get size in bits of the BitStream object 
+ *
+ * @param [in] *bs\n
+ * 	Pointer to bitstream object whose size is to be retrieved
+ * @returns length in BITs of the bit stream
+ */
+inline uint64_t BitStreamGetSizeBits(BitStream *bs) {
+   return bs ? bs->nbits : 0;
+}   
+
+/**
+ * @ingroup Bitstream
+ * @fn uint8_t* BitStreamGetArray(BitStream* bs)
+ * @brief Get the pointer to array holding bitstream
+ *
+ * @param [in] *bs\n
+ * 	Pointer to bitstream object whose size is to be retrieved
+ * @returns pointer to array if valid bitstream, else NULL
+ */
+inline uint8_t* BitStreamGetArray(BitStream *bs) {
+   return bs ? bs->array : NULL;
+}
+ 
+/**
+ * @ingroup Bitstream
+ * @fn BitStream* BitStreamCreate(uint64_t nbits)
+ * @brief Creates a object of type BitStream and allocates space to hold nbits
+ *
+ * Up to BITSTREAM_INLINE_BYTES bytes are held inside the object itself,
+ * saving an allocation for keys and other short streams
+ *
+ * @param [in] nbits\n
+ * 	number of bits to hold in bit stream. If nbits is zero, just a container
+ * 	object is created and new buffer can be added with BitStreamBuffer().
+ * 	Sizes beyond BITSTREAM_MAX_BITS are rejected
+ * @returns pointer to newly created bit stream object, NULL on failure
+ */
+BitStream* BitStreamCreate(uint64_t nbits) {
+   
+   BitStream *bs = NULL;
+
+   if (nbits > BITSTREAM_MAX_BITS)
+      return NULL;
+
+   bs = (BitStream *)malloc(sizeof(BitStream));
+   if (bs != NULL) { 
+
+      bs->flags    = 0;
+      bs->capacity = BITS_TO_BYTES(nbits);
+      if (nbits && BITS_TO_BYTES(nbits) <= BITSTREAM_INLINE_BYTES) {
+        bs->array    = bs->storage;
+        bs->flags    = BITSTREAM_INLINE;
+        bs->capacity = BITSTREAM_INLINE_BYTES;
+        memset(bs->storage, 0, sizeof(bs->storage));
+      } else if (nbits) {
+        bs->array = (uint8_t*)calloc(BITS_TO_BYTES(nbits), 1);
+        if (NULL == bs->array) {
+          free(bs);
+          return NULL;
+        }
+      } else {
+	 bs->array = NULL;
+      }
+      bs->nbits = nbits;
+   }
+
+   return bs;
+}
+
+/**
+ * @ingroup BitStream
+ * @fn BitStream* BitStreamWrap(uint8_t *buffer, uint64_t nbits)
+ *
+ * @brief Creates a bit stream viewing caller owned memory, such as a mapped
+ * 	file or a network buffer, without copying it
+ *
+ * The stream is flagged BITSTREAM_BORROWED: BitStreamDelete leaves the 
+ * buffer alone and a BitStreamRealloc to another size moves the stream to
+ * a buffer of its own. Writes that keep the size go to the wrapped memory
+ *
+ * @param [in] *buffer\n
+ * 	memory holding at least BITS_TO_BYTES(nbits) bytes, it must outlive
+ * 	the stream
+ * @param [in] nbits\n
+ * 	number of bits in the view
+ * @returns pointer to the view, NULL on error
+ */
+BitStream* BitStreamWrap(uint8_t *buffer, uint64_t nbits) {
+   BitStream *bs;
+
+   if ((buffer == NULL && nbits) || nbits > BITSTREAM_MAX_BITS)
+      return NULL;
+
+   bs = (BitStream *)malloc(sizeof(BitStream));
+   if (bs != NULL) {
+      bs->array = nbits ? buffer : NULL;
+      bs->nbits = nbits;
+      bs->flags = nbits ? BITSTREAM_BORROWED : 0;
+      bs->capacity = BITS_TO_BYTES(nbits);
+   }
+   return bs;
+}
+
+/**
+ * @ingroup BitStream
+ * @fn BitStream* BitStreamSlice(BitStream *bs, uint64_t offset, 
+ * 	uint64_t nbits)
+ *
+ * @brief Creates a bit stream for bits [offset, offset + nbits) of bs
+ *
+ * A slice starting on a byte boundary is a BitStreamWrap view into bs and
+ * copies nothing, it is valid as long as bs keeps its buffer. A slice 
+ * starting inside a byte cannot be addressed by a byte pointer and gets
+ * its own copy of the bits, realigned to bit 0
+ *
+ * @param [in] *bs\n
+ * 	bit stream to slice
+ * @param [in] offset\n
+ * 	first bit of the slice
+ * @param [in] nbits\n
+ * 	number of bits in the slice
+ * @returns pointer to the slice, NULL if the range is outside bs or on 
+ * 	allocation failure
+ */
+BitStream* BitStreamSlice(BitStream *bs, uint64_t offset, uint64_t nbits) {
+   BitStream *slice;
+
+   if (bs == NULL || offset > bs->nbits || nbits > bs->nbits - offset)
+      return NULL;
+
+   if (offset % BITS_PER_BYTE == 0)
+      return BitStreamWrap(nbits ? bs->array + offset / BITS_PER_BYTE : NULL,
+		      nbits);
+
+   slice = BitStreamCreate(nbits);
+   if (slice != NULL)
+      bitcopy(slice->array, 0, bs->array, offset, nbits);
+   return slice;
+}
+
+/**
+ * @struct BitStreamArenaBlock
+ * @brief one chunk of memory handed out by a BitStreamArena
+ */
+struct BitStreamArenaBlock {
+   /**< @brief next (older) block */
+   struct BitStreamArenaBlock *next;
+   /**< @brief bytes in data */
+   size_t	size;
+   /**< @brief bytes of data handed out */
+   size_t	used;
+   /**< @brief the memory itself */
+   uint64_t	data[];
+};
+
+/**
+ * @def ARENA_ALIGN
+ * @brief alignment of every arena allocation
+ */
+#define ARENA_ALIGN	sizeof(uint64_t)
+
+/**
+ * @def ARENA_HEADER
+ * @brief offset of the bits from the BitStream object carved with them
+ */
+#define ARENA_HEADER	\
+	((sizeof(BitStream) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+/**
+ * @fn static void* arenaalloc(BitStreamArena *arena, size_t size)
+ *
+ * @brief bump allocates size bytes from the newest block, chaining a new 
+ * 	block when it is full (a block of its own for oversized requests)
+ * @returns pointer to the memory, NULL when out of memory
+ */
+static void* arenaalloc(BitStreamArena *arena, size_t size) {
+    struct BitStreamArenaBlock *b = arena->head;
+    size_t bytes;
+
+    size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+    if (b == NULL || b->size - b->used < size) {
+       bytes = size > arena->blocksize ? size : arena->blocksize;
+       b = malloc(sizeof(*b) + bytes);
+       if (b == NULL)
+          return NULL;
+       b->size = bytes;
+       b->used = 0;
+       b->next = arena->head;
+       arena->head = b;
+    }
+
+    b->used += size;
+    return (uint8_t *)b->data + b->used - size;
+}
+
+/**
+ * @ingroup BitStream
+ * @fn void BitStreamArenaInit(BitStreamArena *arena, size_t blocksize)
+ *
+ * @brief Initialises a bump allocator for short lived bit streams
+ *
+ * An arena is meant to be used by one thread at a time, giving every
+ * worker its own arena keeps the allocator lock out of the hot path
+ *
+ * @param [out] *arena\n
+ * 	arena to initialise, no memory is taken until the first stream
+ * @param [in] blocksize\n
+ * 	bytes fetched from malloc at a time, 0 for BITSTREAM_ARENA_BLOCK
+ */
+void BitStreamArenaInit(BitStreamArena *arena, size_t blocksize) {
+   if (arena != NULL) {
+      arena->head      = NULL;
+      arena->blocksize = blocksize ? blocksize : BITSTREAM_ARENA_BLOCK;
+   }
+}
+
+/**
+ * @ingroup BitStream
+ * @fn BitStream* BitStreamArenaCreate(BitStreamArena *arena, uint64_t nbits)
+ *
+ * @brief Same as BitStreamCreate, with the object and its bits carved from
+ * 	the arena in one piece
+ *
+ * The stream lives until BitStreamArenaReset or BitStreamArenaFree, 
+ * BitStreamDelete on it only releases a buffer it grew into by 
+ * BitStreamRealloc to another size
+ *
+ * @param [in,out] *arena\n
+ * 	arena to allocate from
+ * @param [in] nbits\n
+ * 	number of bits, all zero
+ * @returns pointer to the stream, NULL on error
+ */
+BitStream* BitStreamArenaCreate(BitStreamArena *arena, uint64_t nbits) {
+   BitStream *bs;
+
+   if (arena == NULL || nbits > BITSTREAM_MAX_BITS ||
+       BITS_TO_BYTES(nbits) > SIZE_MAX - ARENA_HEADER - ARENA_ALIGN)
+      return NULL;
+
+   bs = arenaalloc(arena, ARENA_HEADER + BITS_TO_BYTES(nbits));
+   if (bs != NULL) {
+      bs->array = nbits ? (uint8_t *)bs + ARENA_HEADER : NULL;
+      bs->nbits = nbits;
+      bs->flags = BITSTREAM_ARENA | (nbits ? BITSTREAM_BORROWED : 0);
+      bs->capacity = BITS_TO_BYTES(nbits);
+      if (nbits)
+         memset(bs->array, 0, BITS_TO_BYTES(nbits));
+   }
+   return bs;
+}
+
+/**
+ * @ingroup BitStream
+ * @fn void BitStreamArenaReset(BitStreamArena *arena)
+ *
+ * @brief Releases every stream of the arena at once, typically after each
+ * 	batch. One block is kept so the next batch does not call malloc
+ *
+ * @param [in,out] *arena\n
+ * 	arena to reset
+ */
+void BitStreamArenaReset(BitStreamArena *arena) {
+   struct BitStreamArenaBlock *b, *next, *keep = NULL;
+
+   if (arena == NULL)
+      return;
+
+   for (b = arena->head; b != NULL; b = next) {
+      next = b->next;
+      if (keep == NULL && b->size == arena->blocksize) {
+         keep = b;
+         keep->used = 0;
+         keep->next = NULL;
+      } else {
+         free(b);
+      }
+   }
+   arena->head = keep;
+}
+
+/**
+ * @ingroup BitStream
+ * @fn void BitStreamArenaFree(BitStreamArena *arena)
+ *
+ * @brief Returns all memory of the arena to the system
+ *
+ * @param [in,out] *arena\n
+ * 	arena to free, it may be used again as if just initialised
+ */
+void BitStreamArenaFree(BitStreamArena *arena) {
+   struct BitStreamArenaBlock *b, *next;
+
+   if (arena == NULL)
+      return;
+
+   for (b = arena->head; b != NULL; b = next) {
+      next = b->next;
+      free(b);
+   }
+   arena->head = NULL;
+}
+
+/**
+ * @ingroup BitStream
+ * @fn void BitStreamPoolInit(BitStreamPool *pool, uint64_t maxbits)
+ *
+ * @brief Initialises a pool recycling streams of up to maxbits bits
+ *
+ * Slots are carved from an arena and go back to a free list on 
+ * BitStreamPoolPut, so a steady state of creating and dropping small 
+ * streams never calls malloc. Like the arena, a pool serves one thread
+ *
+ * @param [out] *pool\n
+ * 	pool to initialise
+ * @param [in] maxbits\n
+ * 	capacity of every slot in bits
+ */
+void BitStreamPoolInit(BitStreamPool *pool, uint64_t maxbits) {
+   if (pool != NULL) {
+      BitStreamArenaInit(&pool->arena, 0);
+      pool->free    = NULL;
+      pool->maxbits = MIN(maxbits, BITSTREAM_ARENA_BLOCK * BITS_PER_BYTE);
+   }
+}
+
+/**
+ * @ingroup BitStream
+ * @fn BitStream* BitStreamPoolGet(BitStreamPool *pool, uint64_t nbits)
+ *
+ * @brief Same as BitStreamCreate for a stream of at most pool->maxbits
+ * 	bits, taken from the pool. Give it back with BitStreamPoolPut
+ *
+ * @param [in,out] *pool\n
+ * 	pool to take the stream from
+ * @param [in] nbits\n
+ * 	number of bits, all zero
+ * @returns pointer to the stream, NULL if nbits is too large for the pool
+ * 	or on allocation failure
+ */
+BitStream* BitStreamPoolGet(BitStreamPool *pool, uint64_t nbits) {
+   BitStream *bs;
+
+   if (pool == NULL || nbits > pool->maxbits)
+      return NULL;
+
+   bs = pool->free;
+   if (bs != NULL) {
+      pool->free = (BitStream *)bs->array;
+      bs->array  = (uint8_t *)bs + ARENA_HEADER;
+      bs->nbits  = nbits;
+      bs->flags  = BITSTREAM_ARENA | BITSTREAM_BORROWED;
+      bs->capacity = BITS_TO_BYTES(pool->maxbits);
+      memset(bs->array, 0, BITS_TO_BYTES(nbits));
+   } else if ((bs = BitStreamArenaCreate(&pool->arena, pool->maxbits))) {
+      bs->nbits = nbits;
+   }
+   return bs;
+}
+
+/**
+ * @ingroup BitStream
+ * @fn void BitStreamPoolPut(BitStreamPool *pool, BitStream *bs)
+ *
+ * @brief Returns a stream obtained from BitStreamPoolGet to the pool
+ *
+ * @param [in,out] *pool\n
+ * 	pool the stream came from
+ * @param [in] *bs\n
+ * 	stream to recycle, it must not be used afterwards
+ */
+void BitStreamPoolPut(BitStreamPool *pool, BitStream *bs) {
+   if (pool == NULL || bs == NULL)
+      return;
+
+   if (bs->array != NULL && OWNS_ARRAY(bs))
+      free(bs->array);  /* grown out of its slot */
+
+   bs->array  = (uint8_t *)pool->free; /* free list link */
+   pool->free = bs;
+}
+
+/**
+ * @ingroup BitStream
+ * @fn void BitStreamPoolFree(BitStreamPool *pool)
+ *
+ * @brief Returns all memory of the pool to the system, streams still out
+ * 	of the pool become invalid
+ *
+ * @param [in,out] *pool\n
+ * 	pool to free
+ */
+void BitStreamPoolFree(BitStreamPool *pool) {
+   if (pool != NULL) {
+      BitStreamArenaFree(&pool->arena);
+      pool->free = NULL;
+   }
+}
+
+/**
+ * @ingroup Bitstream
+ * @fn BitStream* BitStreamCreateHex(const char* s)
+ * @brief Creates a object of type BitStream and allocates space to hold the
+ * 	HEX byte array passed as argument. The hex byte array in ASCII format
+ * 	is converted to HEX byte array, for instance, "deadbeef" (len 8 bytes)
+ * 	is stored as 0xdeadbeef (length 4 bytes)
+ *
+ * @param [in] s\n
+ * 	HEX buffer string that is filled in the newly allocated BitStream
+ * @returns pointer to newly created bit stream object, NULL on failure
+ */
+BitStream* BitStreamCreateHex(const char* s) {
+   BitStream* bs = NULL;
+
+   bs = BitStreamCreate(0); /* Empty container */
+
+   if (BitStreamCopyHex(bs, s) <= 0) {
+	   BitStreamDelete(bs);
+	   bs = NULL;
+   }
+   return bs;
+}
+
+/**
+ * @ingroup Bitstream
+ * @fn BitStream* BitStreamCreateAscii(const char* s)
+ * @brief Creates a object of type BitStream and allocates space to hold the
+ * 	ASCII byte array passed as argument
+ *
+ * @param [in] s\n
+ * 	ASCII buffer string that is filled in the newly allocated BitStream
+ * @returns pointer to newly created bit stream object, NULL on failure
+ */
+BitStream* BitStreamCreateAscii(const char* s) {
+   BitStream* bs = NULL;
+
+   bs = BitStreamCreate(0); /* Empty container */
+
+   if (BitStreamCopyAscii(bs, s) <= 0) {
+	   BitStreamDelete(bs);
+	   bs = NULL;
+   }
+   return bs;
+}
+
+/**
+ * @ingroup Bitstream
+ * @fn BitStream* BitStreamCreateBase64(const char* s, uint32_t flags)
+ * @brief Creates a object of type BitStream holding the bytes decoded from
+ * 	the Base64 string passed as argument, see BitStreamCopyBase64
+ *
+ * @param [in] s\n
+ * 	Base64 buffer string that is decoded in the newly allocated BitStream
+ * @param [in] flags\n
+ * 	BASE64_URLSAFE, BASE64_SKIPSPACE
+ * @returns pointer to newly created bit stream object, NULL on failure
+ */
+BitStream* BitStreamCreateBase64(const char* s, uint32_t flags) {
+   BitStream* bs = NULL;
+
+   bs = BitStreamCreate(0); /* Empty container */
+
+   if (BitStreamCopyBase64(bs, s, flags, NULL) <= 0) {
+	   BitStreamDelete(bs);
+	   bs = NULL;
+   }
+   return bs;
+}
+/**
+ * @ingroup Bitstream
+ *
+ * @fn int BitStreamRealloc(BitStream* bs, uint8_t *buffer, uint64_t nbits) 
+ *
+ * @brief Reinitialize the BitStream buffer to a new one
+ * 	Routine will create a new one with number of bits if not provided
+ * 	else use the buffer provided as param
+ * 	In case there's no new buffer provided, it calls realloc() to adjust
+ * 	the size of the allocated buffer
+ * @param [in] bs\n
+ * 	BitStream object to operate on
+ * @param [in] *buffer\n
+ * 	Buffer pointer to use for reallocation, if NULL, either a new one or 
+ * 	reallocated one will be used. Sizes within the capacity of the
+ * 	stream only change nbits. A borrowed buffer (BitStreamWrap) is never
+ * 	freed or reallocated, growing copies the bits to a new buffer.
+ * 	Sizes up to BITSTREAM_INLINE_BYTES go to the inline storage of an 
+ * 	empty stream, or of a borrowed one resized to a different size (even
+ * 	a shrink), larger ones spill to the heap
+ * @param [in] nbits\n
+ * 	size in bits of the new buffer, at most BITSTREAM_MAX_BITS
+ * @returns 0 on success, -1 if the size is out of range or allocation fails,
+ * 	in which case the stream is left untouched
+ */
+int BitStreamRealloc(BitStream* bs, uint8_t *buffer, uint64_t nbits) {
+   uint8_t  *array;
+   uint32_t where = 0;
+   size_t   bytes = BITS_TO_BYTES(nbits);
+
+   if (bs == NULL || nbits > BITSTREAM_MAX_BITS)
+      return (-1);
+
+   if (buffer) {
+      array = buffer;
+   } else if (nbits && bytes <= BITSTREAM_INLINE_BYTES && 
+	      (bs->array == NULL || 
+	       ((bs->flags & BITSTREAM_BORROWED) && nbits != bs->nbits))) {
+      /* ahead of the capacity test, a borrowed buffer is not ours to keep */
+      array = bs->storage;
+      where = BITSTREAM_INLINE;
+      if (bs->array)
+         memcpy(array, bs->array, BITS_TO_BYTES(MIN(nbits, bs->nbits)));
+   } else if (nbits && bytes <= bs->capacity) {
+      bs->nbits = nbits;
+      return 0;
+   } else if (nbits && !OWNS_ARRAY(bs)) {
+      if ((array = (uint8_t *)malloc(bytes)) == NULL)
+         return (-1);
+      memcpy(array, bs->array, BITS_TO_BYTES(MIN(nbits, bs->nbits)));
+   } else if (nbits) {
+      array = (uint8_t *)realloc(bs->array, bytes);
+      if (array == NULL)
+         return (-1);
+   } else {
+      array = NULL;
+   }
+
+   if (bs->array && bs->array != array && (buffer || !nbits) && 
+       OWNS_ARRAY(bs))
+      free(bs->array);
+
+   bs->array    = array;
+   bs->nbits    = nbits;
+   bs->capacity = where ? BITSTREAM_INLINE_BYTES : bytes;
+   bs->flags    = (bs->flags & ~(BITSTREAM_BORROWED | BITSTREAM_INLINE)) | 
+	   where;
+
+   return 0;
+}
+
+
+/**
+ * @ingroup BitStream
+ * @fn void BitStreamDelete(BitStream* bs)
+ *
+ * @brief Deletes the bit stream object, frees the memory holding bits
+ *
+ * @param [in] bs\n
+ * 	pointer to bit stream object
+ * @returns none
+ */
+void BitStreamDelete(BitStream* bs) {
+   if (bs != NULL) {
+      if (bs->array != NULL && OWNS_ARRAY(bs)) {
+         free(bs->array);
+      }
+      if (bs->flags & BITSTREAM_ARENA) {
+         bs->array = NULL; /* the object goes with its arena */
+         return;
+      }
+      free(bs);
+   }
+}
+
+/**
+ * @ingroup BitStream
+ * @fn void BitSreamShow(BitStream* bs, const char* fmt)
+ * @brief Show contents of bit stream as hex array in "pretty" format 
+ * 	prints both ascii and hex values helpful in debugging
+ *
+ * @param [in]	bs\n
+ *  	pointer to bitstream to show
+ * @returns void
+ */
+void BitStreamShow(BitStream* bs) {
+   uint64_t i = 0;
+
+   char repr[32] = {'\0'};
+
+   if (bs != NULL && bs->array != NULL) {
+      printf("%03d\t", 0);
+      for (i = 0; i < BITS_TO_BYTES(bs->nbits); i++) {
+
+         if ((i != 0) && (i % 8 == 0))
+		 printf("  ");
+         if ((i != 0) && (i % 16 == 0)) 
+		 printf("%s\n%03llu\t", repr, (unsigned long long)i);
+
+         sprintf(repr + (i % 16),"%c", isprint(bs->array[i]) ? bs->array[i] : 
+			 '.');
+         printf("%02x", bs->array[i]);
+      }
+      /* Now print the remaining gap till the place holder for ascii
+       */
+      if (strlen(repr) < 16) {
+         while (i++ % 16) {
+	    printf("  ");
+            if ((i != 0) && (i % 8 == 0))
+	       printf("  ");
+         }
+      } else {
+	   printf("  ");
+      } /* if strlen(repr) < 16 */
+      printf("%s\n", repr); /* push out the left over characters from loop */
+   } 
+   printf("\n");
+}
+
+#if defined(BITSTREAM_X86)
+/**
+ * @fn void hexencode_ssse3(const uint8_t *in, char *out, const char *digits)
+ *
+ * @brief Converts 16 bytes into 32 hex ascii characters, nibbles are mapped
+ * 	to digits with one pshufb against the 16 entry digit table
+ */
+__attribute__((target("ssse3")))
+static void hexencode_ssse3(const uint8_t *in, char *out, const char *digits) {
+    __m128i lut = _mm_loadu_si128((const __m128i *)digits);
+    __m128i m   = _mm_set1_epi8(0x0F);
+    __m128i v   = _mm_loadu_si128((const __m128i *)in);
+    __m128i hi  = _mm_shuffle_epi8(lut, _mm_and_si128(_mm_srli_epi16(v, 4), m));
+    __m128i lo  = _mm_shuffle_epi8(lut, _mm_and_si128(v, m));
+
+    _mm_storeu_si128((__m128i *)out, _mm_unpacklo_epi8(hi, lo));
+    _mm_storeu_si128((__m128i *)(out + 16), _mm_unpackhi_epi8(hi, lo));
+}
+
+/**
+ * @fn void hexencode_avx2(const uint8_t *in, char *out, const char *digits)
+ *
+ * @brief Converts 32 bytes into 64 hex ascii characters, same scheme as
+ * 	hexencode_ssse3(), the in-lane unpacks are put back in order with
+ * 	cross lane permutes
+ */
+__attribute__((target("avx2")))
+static void hexencode_avx2(const uint8_t *in, char *out, const char *digits) {
+    __m256i lut = _mm256_broadcastsi128_si256(
+		    _mm_loadu_si128((const __m128i *)digits));
+    __m256i m   = _mm256_set1_epi8(0x0F);
+    __m256i v   = _mm256_loadu_si256((const __m256i *)in);
+    __m256i hi  = _mm256_shuffle_epi8(lut, 
+		    _mm256_and_si256(_mm256_srli_epi16(v, 4), m));
+    __m256i lo  = _mm256_shuffle_epi8(lut, _mm256_and_si256(v, m));
+    __m256i a   = _mm256_unpacklo_epi8(hi, lo);
+    __m256i b   = _mm256_unpackhi_epi8(hi, lo);
+
+    _mm256_storeu_si256((__m256i *)out, _mm256_permute2x128_si256(a, b, 0x20));
+    _mm256_storeu_si256((__m256i *)(out + 32), 
+		    _mm256_permute2x128_si256(a, b, 0x31));
+}
+#endif /* BITSTREAM_X86 */
+
+/**
+ * @fn void hexencode(const uint8_t *in, size_t n, char *out, int upper)
+ *
+ * @brief Converts n bytes into 2n hex ascii characters, not NULL terminated
+ *
+ * The bulk goes through the widest SIMD kernel the cpu supports, the rest
+ * through the digit table
+ */
+static void hexencode(const uint8_t *in, size_t n, char *out, int upper) {
+   const char *digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+   size_t   i = 0;
+#if defined(BITSTREAM_X86)
+   uint32_t cpu = cpu_features();
+
+   if (cpu & CPU_AVX2) {
+      for (; i + 32 <= n; i += 32)
+         hexencode_avx2(in + i, out + 2 * i, digits);
+   }
+   if (cpu & CPU_SSSE3) {
+      for (; i + 16 <= n; i += 16)
+         hexencode_ssse3(in + i, out + 2 * i, digits);
+   }
+#endif
+
+   for (; i < n; i++) {
+      out[2 * i]     = digits[in[i] >> 4];
+      out[2 * i + 1] = digits[in[i] & 0x0F];
+   }
+}
+
+/**
+ * @ingroup BitStream
+ * @fn uint64_t BitStreamToHex(BitStream* bs, char* out, size_t size,\n
+ * 	int upper)
+ *
+ * @brief Writes the contents of bit stream as HEX ascii characters, the
+ * 	reverse of BitStreamCopyHex
+ *
+ * Every byte of the stream becomes two characters, a trailing partial byte
+ * is written whole. The output is NULL terminated.
+ *
+ * @param [in] bs\n
+ * 	bit stream to convert
+ * @param [out] out\n
+ * 	buffer receiving the characters, needs 2 characters per byte of the
+ * 	stream plus the terminating NULL
+ * @param [in] size\n
+ * 	size of the output buffer
+ * @param [in] upper\n
+ * 	non zero for upper case digits A-F, lower case otherwise
+ * @returns number of characters written excluding the NULL, 0 if the output
+ * 	buffer is too small
+ */
+uint64_t BitStreamToHex(BitStream* bs, char* out, size_t size, int upper) {
+   size_t nbytes;
+
+   if (bs == NULL || out == NULL)
+      return 0;
+
+   nbytes = BITS_TO_BYTES(bs->nbits);
+   if (size == 0 || nbytes > (size - 1) / 2)
+      return 0;
+
+   hexencode(bs->array, nbytes, out, upper);
+   out[2 * nbytes] = '\0';
+
+   return (uint64_t)nbytes * 2;
+}
+
+/**
+ * @ingroup BitStream
+ * @fn uint64_t BitStreamPutByte(BitStream* bs, uint8_t byte, uint64_t offset,\n 
+ * 	uint64_t nbits) 
+ *
+ * @brief inserts maximum 1 byte of data in bit stream at offset (in bits) nbits
+ *
+ * If the number of bits inserted are less than BITS_PER_BYTE (8) then the bits
+ * are shifted left so that they are aligned in network order, i.e, inserting 3 
+ * bits (101b) will cause the bits to be inserted in the specified byte as follows
+ * 	- 101xxxxxb
+ * where 'x' indicates the existing bits in stream
+ *
+ * @param [in] bs\n
+ * 	Bit stream in which the bits are to be inserted
+ * @param [in] byte\n
+ * 	Bits to be inserted in bit stream (maximum 8)
+ * @param [in] offset\n
+ * 	offset in bits at which the above byte is to be inserted
+ * @param [in] nbits\n
+ * 	number of bits to insert, by default is should be 8, else the shift as
+ * 	explained above applies
+ * @returns Number of bits inserted. Insertion fails while inserting bits 
+ * 	beyond the size of bit stream
+ */
+uint64_t BitStreamPutByte(BitStream* bs, uint8_t byte, uint64_t offset, 
+	uint64_t nbits) {
+
+   uint64_t curBits;
+   uint8_t mask;
+   uint64_t bitsCopied = 0;
+
+   DECL_BYTE_OFFSET(i);
+   DECL_BITS_OFFSET(j);
+
+   if (offset >= bs->nbits)
+	   return 0;
+
+   nbits = MIN(nbits, (bs->nbits - offset));
+
+   if (nbits < 8) byte = byte << (BITS_PER_BYTE - nbits);
+
+   curBits = MIN((BITS_PER_BYTE - j), nbits);
+
+   mask = (0xFF >> j) & (0xFF << (BITS_PER_BYTE - (j + curBits)));
+
+   bs->array[i] = (bs->array[i] & ~mask) | ((byte >> j) & mask);
+
+   bitsCopied += curBits;
+
+   byte = byte << curBits;
+
+   if (curBits < nbits) {
+      curBits = nbits - curBits;
+
+      mask = 0xFF << (BITS_PER_BYTE - curBits);
+
+      bs->array[i + 1] = (bs->array[i + 1] & ~mask) | (byte & mask);
+
+      bitsCopied += curBits;
+   }
+   return bitsCopied;
+}
+
+/**
+ * @ingroup BitStream
+ * @fn uint64_t BitStreamGetByte(BitStream* bs, uint8_t *byte, uint64_t offset,\n 
+ * 	uint64_t nbits) 
+ *
+ * @brief fetches maximum 1 byte of data in bit stream at offset (in bits) nbits
+ *
+ * If the number of bits requested are less than BITS_PER_BYTE (8) then the bits
+ * are shifted right so that they are aligned in host order, i.e, requesting 3 
+ * bits at offset 0, will fetch the bits as 00000xxx where xxx are the fetched 
+ * bits
+ *
+ * @param [in] bs\n
+ * 	Bit stream in which the bits are to be inserted
+ * @param [out] *byte\n
+ * 	Bits fetched from the stream (maxium 8)
+ * @param [in] offset\n
+ * 	offset in bits from which the above byte is to be fetched
+ * @param [in] nbits\n
+ * 	number of bits to insert, by default is should be 8, else the shift as
+ * 	explained above applies
+ * @returns Number of bits fetched. Retrieval fails while fetching bits 
+ * 	beyond the size of bit stream
+ */
+uint64_t BitStreamGetByte(BitStream *bs, uint8_t *byte, uint64_t offset, 
+		uint64_t nbits) {
+
+   uint64_t curBits;
+   uint8_t mask;
+   uint64_t bitsCopied = 0;
+
+   DECL_BYTE_OFFSET(i);
+   DECL_BITS_OFFSET(j);
+
+   if (offset >= bs->nbits)
+	   return (0);
+
+   nbits = MIN(nbits, (bs->nbits - offset));
+
+   curBits = MIN((BITS_PER_BYTE - j), nbits);
+
+   mask = (0xFF >> j) & (0xFF << (BITS_PER_BYTE - (j + curBits)));
+
+   *byte = (bs->array[i] & mask) << j;
+
+   bitsCopied += curBits;
+
+   if (curBits < nbits) {
+      curBits = nbits - curBits;
+
+      mask = 0xFF << (BITS_PER_BYTE - curBits);
+
+      *byte |= (bs->array[i + 1] & mask) >> (BITS_PER_BYTE - j);
+
+      bitsCopied += curBits;
+   }
+
+   if (nbits < 8) *byte = *byte >> (BITS_PER_BYTE - nbits);
+
+   return bitsCopied;
+}
+
+/**
+ * @ingroup BitStream
+ * @fn uint64_t BitStreamGetBits(BitStream *bs, uint64_t *value,\n
+ * 	uint64_t offset, uint64_t nbits, BitStreamOrder order)
+ *
+ * @brief fetches a field of up to 64 bits from bit stream at offset (in bits)
+ *
+ * The field is returned right aligned in *value. With BITSTREAM_MSB_FIRST the
+ * first bit of the field is its most significant bit and bits are numbered
+ * from the top of each byte, like BitStreamGetByte. With BITSTREAM_LSB_FIRST
+ * bits are numbered from the bottom of each byte and the first bit of the 
+ * field is its least significant bit (the DEFLATE convention).
+ *
+ * The field is read with one unaligned 64 bit load plus at most one extra
+ * byte, streams shorter than 8 bytes past offset go through a bounce buffer
+ *
+ * @param [in] bs\n
+ * 	Bit stream to fetch the bits from
+ * @param [out] *value\n
+ * 	Bits fetched from the stream, right aligned
+ * @param [in] offset\n
+ * 	offset in bits from which the field is to be fetched
+ * @param [in] nbits\n
+ * 	width of the field, 1 to 64
+ * @param [in] order\n
+ * 	bit order of the field, BITSTREAM_MSB_FIRST or BITSTREAM_LSB_FIRST
+ * @returns Number of bits fetched. Retrieval is clipped at the end of the 
+ * 	bit stream
+ */
+uint64_t BitStreamGetBits(BitStream *bs, uint64_t *value, uint64_t offset, 
+		uint64_t nbits, BitStreamOrder order) {
+
+   const uint8_t *p;
+   uint8_t  tmp[8] = {0};
+   uint64_t w, v;
+   size_t   avail;
+
+   DECL_BYTE_OFFSET(i);
+   DECL_BITS_OFFSET(j);
+
+   if (bs == NULL || bs->array == NULL || offset > bs->nbits)
+	   return (0);
+
+   nbits = MIN(MIN(nbits, 64), (bs->nbits - offset));
+   if (nbits == 0)
+	   return (0);
+
+   p = bs->array + i;
+   avail = BITS_TO_BYTES(bs->nbits) - i;
+   if (avail < sizeof(tmp)) {
+      memcpy(tmp, p, avail);
+      p = tmp;
+   }
+
+   if (order == BITSTREAM_LSB_FIRST) {
+      w = load64le(p) >> j;
+      if (j + nbits > 64)
+         w |= (uint64_t)p[8] << (64 - j);
+      v = nbits < 64 ? w & ((1ULL << nbits) - 1) : w;
+   } else {
+      w = load64be(p) << j;
+      if (j + nbits > 64)
+         w |= p[8] >> (BITS_PER_BYTE - j);
+      v = w >> (64 - nbits);
+   }
+
+   *value = v;
+
+   return nbits;
+}
+
+/**
+ * @ingroup BitStream
+ * @fn uint64_t BitStreamPutBits(BitStream *bs, uint64_t value,\n
+ * 	uint64_t offset, uint64_t nbits, BitStreamOrder order)
+ *
+ * @brief inserts a field of up to 64 bits in bit stream at offset (in bits)
+ *
+ * The low nbits of value are inserted, bit order follows BitStreamGetBits.
+ * Bits of the stream around the field are preserved
+ *
+ * @param [in] bs\n
+ * 	Bit stream in which the bits are to be inserted
+ * @param [in] value\n
+ * 	Field to be inserted, right aligned
+ * @param [in] offset\n
+ * 	offset in bits at which the field is to be inserted
+ * @param [in] nbits\n
+ * 	width of the field, 1 to 64
+ * @param [in] order\n
+ * 	bit order of the field, BITSTREAM_MSB_FIRST or BITSTREAM_LSB_FIRST
+ * @returns Number of bits inserted. Insertion is clipped at the end of the 
+ * 	bit stream
+ */
+uint64_t BitStreamPutBits(BitStream *bs, uint64_t value, uint64_t offset, 
+		uint64_t nbits, BitStreamOrder order) {
+
+   uint8_t  *p;
+   uint8_t  tmp[8] = {0};
+   uint64_t w, mask;
+   uint64_t spill;
+   size_t   avail;
+
+   DECL_BYTE_OFFSET(i);
+   DECL_BITS_OFFSET(j);
+
+   if (bs == NULL || bs->array == NULL || offset > bs->nbits)
+	   return (0);
+
+   nbits = MIN(MIN(nbits, 64), (bs->nbits - offset));
+   if (nbits == 0)
+	   return (0);
+
+   if (nbits < 64)
+      value &= (1ULL << nbits) - 1;
+
+   p = bs->array + i;
+   avail = BITS_TO_BYTES(bs->nbits) - i;
+   if (avail < sizeof(tmp)) {
+      memcpy(tmp, p, avail);
+      p = tmp;
+   }
+
+   /* bits of the field that land in the 9th byte */
+   spill = j + nbits > 64 ? j + nbits - 64 : 0;
+
+   if (order == BITSTREAM_LSB_FIRST) {
+      mask = (~0ULL >> (64 - (nbits - spill))) << j;
+      w = load64le(p);
+      store64le(p, (w & ~mask) | ((value << j) & mask));
+      if (spill)
+         p[8] = (p[8] & (0xFF << spill)) | (uint8_t)(value >> (64 - j));
+   } else {
+      mask = (~0ULL >> (64 - (nbits - spill))) << (64 - j - (nbits - spill));
+      w = load64be(p);
+      store64be(p, (w & ~mask) | 
+		      ((spill ? value >> spill : value << (64 - j - nbits)) & mask));
+      if (spill)
+         p[8] = (p[8] & (0xFF >> spill)) | 
+		 (uint8_t)(value << (BITS_PER_BYTE - spill));
+   }
+
+   if (p == tmp)
+      memcpy(bs->array + i, tmp, avail);
+
+   return nbits;
+}
+
+/**
+ * @fn void BitReaderRefill(BitReader *br)
+ *
+ * @brief Tops up the bit buffer of the reader to at least 56 bits
+ *
+ * In the body of the stream one unaligned 64 bit load is merged into the
+ * buffer and the byte cursor advances by however many whole bytes fitted,
+ * there are no per byte branches. Within the last 8 bytes the buffer is
+ * filled one byte at a time, masking the unused bits of a partial last byte
+ * and padding with zero bytes past the end so that peeks beyond the stream
+ * return zero bits.
+ */
+static inline void BitReaderRefill(BitReader *br) {
+   uint64_t w;
+   uint32_t tail = br->nbits % BITS_PER_BYTE;
+
+   if (br->pos + 8 <= br->nbits / BITS_PER_BYTE) {
+      if (br->order == BITSTREAM_LSB_FIRST) {
+         w = load64le(br->array + br->pos);
+         br->buffer |= w << br->count;
+      } else {
+         w = load64be(br->array + br->pos);
+         br->buffer |= w >> br->count;
+      }
+      br->pos   += (63 - br->count) >> 3;
+      br->count |= 56;
+   } else {
+      while (br->count <= 56) {
+         w = br->pos < br->nbytes ? br->array[br->pos] : 0;
+         if (br->order == BITSTREAM_LSB_FIRST) {
+            if (br->pos == br->nbits / BITS_PER_BYTE)
+               w &= (1U << tail) - 1;
+            br->buffer |= w << br->count;
+         } else {
+            if (br->pos == br->nbits / BITS_PER_BYTE)
+               w &= 0xFF << (BITS_PER_BYTE - tail);
+            br->buffer |= w << (56 - br->count);
+         }
+         br->pos++;
+         br->count += BITS_PER_BYTE;
+      }
+   }
+}
+
+/**
+ * @ingroup BitStream
+ * @fn int BitReaderInit(BitReader *br, BitStream *bs, uint64_t offset,\n
+ * 	BitStreamOrder order)
+ *
+ * @brief Sets up a sequential reader over the bit stream
+ *
+ * The reader keeps a pointer to the stream buffer, the stream must not be 
+ * reallocated while the reader is in use
+ *
+ * @param [out] br\n
+ * 	reader to initialise
+ * @param [in] bs\n
+ * 	bit stream to read from
+ * @param [in] offset\n
+ * 	bit offset of the first bit to read
+ * @param [in] order\n
+ * 	bit order of the fields, see BitStreamGetBits
+ * @returns 0 on success, -1 if stream is invalid or offset is past its end
+ */
+int BitReaderInit(BitReader *br, BitStream *bs, uint64_t offset, 
+		BitStreamOrder order) {
+
+   if (br == NULL || bs == NULL || offset > bs->nbits)
+      return (-1);
+
+   br->array  = bs->array;
+   br->nbits  = bs->nbits;
+   br->nbytes = BITS_TO_BYTES(bs->nbits);
+   br->order  = order;
+   br->pos    = offset / BITS_PER_BYTE;
+   br->buffer = 0;
+   br->count  = 0;
+
+   if (offset % BITS_PER_BYTE) {
+      BitReaderRefill(br);
+      BitReaderSkip(br, offset % BITS_PER_BYTE);
+   }
+   return 0;
+}
+
+/**
+ * @ingroup BitStream
+ * @fn uint64_t BitReaderTell(BitReader *br)
+ *
+ * @brief Bit offset in the stream of the next bit to be consumed
+ */
+uint64_t BitReaderTell(BitReader *br) {
+   return (uint64_t)br->pos * BITS_PER_BYTE - br->count;
+}
+
+/**
+ * @ingroup BitStream
+ * @fn uint64_t BitReaderRemaining(BitReader *br)
+ *
+ * @brief Number of bits left in the stream after the reader position
+ */
+uint64_t BitReaderRemaining(BitReader *br) {
+   uint64_t at = BitReaderTell(br);
+
+   return at < br->nbits ? br->nbits - at : 0;
+}
+
+/**
+ * @ingroup BitStream
+ * @fn uint64_t BitReaderPeek(BitReader *br, uint32_t nbits)
+ *
+ * @brief Returns the next nbits of the stream without consuming them
+ *
+ * @param [in,out] br\n
+ * 	reader to peek from, its bit buffer may get refilled
+ * @param [in] nbits\n
+ * 	number of bits to look at, 1 to BITREADER_MAX_PEEK
+ * @returns the bits, right aligned, bits past the end of stream read as 0
+ */
+uint64_t BitReaderPeek(BitReader *br, uint32_t nbits) {
+
+   assert(nbits > 0 && nbits <= BITREADER_MAX_PEEK);
+
+   if (br->count < nbits)
+      BitReaderRefill(br);
+
+   if (br->order == BITSTREAM_LSB_FIRST)
+      return br->buffer & ((1ULL << nbits) - 1);
+   return br->buffer >> (64 - nbits);
+}
+
+/**
+ * @ingroup BitStream
+ * @fn uint64_t BitReaderSkip(BitReader *br, uint64_t nbits)
+ *
+ * @brief Advances the reader by nbits without looking at them
+ *
+ * @param [in,out] br\n
+ * 	reader to advance
+ * @param [in] nbits\n
+ * 	number of bits to skip, clipped at the end of stream
+ * @returns number of bits skipped
+ */
+uint64_t BitReaderSkip(BitReader *br, uint64_t nbits) {
+   uint64_t at;
+
+   nbits = MIN(nbits, BitReaderRemaining(br));
+
+   if (nbits <= br->count) {
+      if (br->order == BITSTREAM_LSB_FIRST)
+         br->buffer = nbits < 64 ? br->buffer >> nbits : 0;
+      else
+         br->buffer = nbits < 64 ? br->buffer << nbits : 0;
+      br->count -= nbits;
+   } else {
+      /* past the buffered bits, restart from the new byte position */
+      at = BitReaderTell(br) + nbits;
+      br->pos    = at / BITS_PER_BYTE;
+      br->buffer = 0;
+      br->count  = 0;
+      if (at % BITS_PER_BYTE) {
+         BitReaderRefill(br);
+         BitReaderSkip(br, at % BITS_PER_BYTE);
+      }
+   }
+   return nbits;
+}
+
+/**
+ * @ingroup BitStream
+ * @fn uint64_t BitReaderConsume(BitReader *br, uint32_t nbits)
+ *
+ * @brief Returns the next nbits of the stream and advances past them
+ *
+ * @param [in,out] br\n
+ * 	reader to consume from
+ * @param [in] nbits\n
+ * 	number of bits to consume, 1 to 64
+ * @returns the bits, right aligned, bits past the end of stream read as 0
+ */
+uint64_t BitReaderConsume(BitReader *br, uint32_t nbits) {
+   uint64_t hi, lo;
+
+   if (nbits > BITREADER_MAX_PEEK) {
+      hi = BitReaderConsume(br, nbits - 32);
+      lo = BitReaderConsume(br, 32);
+      return br->order == BITSTREAM_LSB_FIRST ? 
+	      (lo << (nbits - 32)) | hi : (hi << 32) | lo;
+   }
+
+   hi = BitReaderPeek(br, nbits);
+   BitReaderSkip(br, nbits);
+
+   return hi;
+}
+
+/**
+ * @ingroup BitStream
+ * @fn int BitWriterInit(BitWriter *bw, BitStream *bs, uint64_t offset,\n
+ * 	BitStreamOrder order)
+ *
+ * @brief Sets up a sequential writer into the bit stream
+ *
+ * Bits before offset are preserved, only the whole bytes the writer has
+ * completed are stored as the buffer drains. The bits after the writer 
+ * position, including the rest of a final partial byte written by 
+ * BitWriterFlush(), keep their contents, so a field can be patched inside
+ * an existing stream. The stream must not be reallocated while the writer
+ * is in use
+ *
+ * @param [out] bw\n
+ * 	writer to initialise
+ * @param [in] bs\n
+ * 	bit stream to write into
+ * @param [in] offset\n
+ * 	bit offset of the first bit to write
+ * @param [in] order\n
+ * 	bit order of the fields, see BitStreamPutBits
+ * @returns 0 on success, -1 if stream is invalid or offset is past its end
+ */
+int BitWriterInit(BitWriter *bw, BitStream *bs, uint64_t offset, 
+		BitStreamOrder order) {
+   uint32_t j = offset % BITS_PER_BYTE;
+
+   if (bw == NULL || bs == NULL || offset > bs->nbits)
+      return (-1);
+
+   bw->array  = bs->array;
+   bw->nbits  = bs->nbits;
+   bw->nbytes = BITS_TO_BYTES(bs->nbits);
+   bw->order  = order;
+   bw->pos    = offset / BITS_PER_BYTE;
+   bw->buffer = 0;
+   bw->count  = j;
+
+   /* carry the leading bits of a partial first byte through the buffer */
+   if (j) {
+      if (order == BITSTREAM_LSB_FIRST)
+         bw->buffer = bw->array[bw->pos] & ((1U << j) - 1);
+      else
+         bw->buffer = (uint64_t)(bw->array[bw->pos] & (0xFF << (8 - j))) << 56;
+   }
+   return 0;
+}
+
+/**
+ * @fn void BitWriterDrain(BitWriter *bw)
+ *
+ * @brief Moves the whole bytes of the bit buffer into the stream
+ */
+static inline void BitWriterDrain(BitWriter *bw) {
+   uint32_t k = bw->count >> 3;
+   uint32_t b;
+
+   if (k == 8 && bw->pos + 8 <= bw->nbytes) {
+      if (bw->order == BITSTREAM_LSB_FIRST)
+         store64le(bw->array + bw->pos, bw->buffer);
+      else
+         store64be(bw->array + bw->pos, bw->buffer);
+   } else {
+      for (b = 0; b < k; b++) {
+         if (bw->order == BITSTREAM_LSB_FIRST)
+            bw->array[bw->pos + b] = (uint8_t)(bw->buffer >> (8 * b));
+         else
+            bw->array[bw->pos + b] = (uint8_t)(bw->buffer >> (56 - 8 * b));
+      }
+   }
+
+   bw->pos   += k;
+   bw->count &= 7;
+   if (k == 8)
+      bw->buffer = 0;
+   else if (bw->order == BITSTREAM_LSB_FIRST)
+      bw->buffer >>= 8 * k;
+   else
+      bw->buffer <<= 8 * k;
+}
+
+/**
+ * @ingroup BitStream
+ * @fn uint64_t BitWriterTell(BitWriter *bw)
+ *
+ * @brief Bit offset in the stream of the next bit to be written
+ */
+uint64_t BitWriterTell(BitWriter *bw) {
+   return (uint64_t)bw->pos * BITS_PER_BYTE + bw->count;
+}
+
+/**
+ * @ingroup BitStream
+ * @fn uint64_t BitWriterPut(BitWriter *bw, uint64_t value, uint32_t nbits)
+ *
+ * @brief Appends the low nbits of value at the writer position
+ *
+ * @param [in,out] bw\n
+ * 	writer to append to
+ * @param [in] value\n
+ * 	bits to write, right aligned
+ * @param [in] nbits\n
+ * 	number of bits to write, 1 to 64, clipped at the end of stream
+ * @returns number of bits written
+ */
+uint64_t BitWriterPut(BitWriter *bw, uint64_t value, uint32_t nbits) {
+   uint64_t room = bw->nbits - BitWriterTell(bw);
+
+   if (nbits > room)
+      nbits = room;
+   if (nbits == 0)
+      return 0;
+
+   if (nbits > BITREADER_MAX_PEEK) {
+      if (bw->order == BITSTREAM_LSB_FIRST) {
+         BitWriterPut(bw, value, 32);
+         BitWriterPut(bw, value >> 32, nbits - 32);
+      } else {
+         BitWriterPut(bw, value >> 32, nbits - 32);
+         BitWriterPut(bw, value, 32);
+      }
+      return nbits;
+   }
+
+   value &= (1ULL << nbits) - 1;
+
+   if (bw->count + nbits > 64)
+      BitWriterDrain(bw);
+
+   if (bw->order == BITSTREAM_LSB_FIRST)
+      bw->buffer |= value << bw->count;
+   else
+      bw->buffer |= value << (64 - bw->count - nbits);
+   bw->count += nbits;
+
+   return nbits;
+}
+
+/**
+ * @ingroup BitStream
+ * @fn uint64_t BitWriterFlush(BitWriter *bw)
+ *
+ * @brief Writes out all buffered bits, the trailing bits of a final partial
+ * 	byte keep their contents
+ *
+ * @param [in,out] bw\n
+ * 	writer to flush, it can continue to be used afterwards
+ * @returns bit offset of the writer position
+ */
+uint64_t BitWriterFlush(BitWriter *bw) {
+   uint8_t mask, bits;
+
+   BitWriterDrain(bw);
+
+   if (bw->count) {
+      if (bw->order == BITSTREAM_LSB_FIRST) {
+         mask = (uint8_t)((1U << bw->count) - 1);
+         bits = (uint8_t)bw->buffer;
+      } else {
+         mask = (uint8_t)(0xFF << (BITS_PER_BYTE - bw->count));
+         bits = (uint8_t)(bw->buffer >> 56);
+      }
+      bw->array[bw->pos] = (bw->array[bw->pos] & ~mask) | (bits & mask);
+   }
+   return BitWriterTell(bw);
+}
+
+/**
+ * @ingroup BitStream
+ * @fn uint64_t BitStreamCopy(BitStream* bs, const uint8_t* inp, uint64_t nbits) 
+ *
+ * @brief Copies the bytes from input buffer into bit stream
+ *
+ * Bits are taken in network order, so a trailing partial byte contributes
+ * its most significant bits
+ *
+ * @param [in,out] bs\n
+ * 	bit stream to fill data in
+ * @param [in] *inp\n
+ * 	pointer to the data to be copied
+ * @param [in] nbits\n
+ * 	size of input data in bits
+ * @returns number of bits copied into bit stream
+ */
+uint64_t BitStreamCopy(BitStream* bs, const uint8_t* inp, uint64_t nbits) {
+
+   if (bs == NULL || bs->array == NULL || inp == NULL)
+      return 0;
+
+   nbits = MIN(nbits, bs->nbits);
+
+   bitcopy(bs->array, 0, inp, 0, nbits);
+
+   return nbits;
+}
+
+/**
+ * @ingroup BitStream
+ * @fn uint64_t BitStreamCopyBits(BitStream* dst, uint64_t dstOffset,\n
+ * 	BitStream* src, uint64_t srcOffset, uint64_t nbits)
+ *
+ * @brief Copies a range of bits between two bit streams at arbitrary bit
+ * 	offsets
+ *
+ * Byte aligned ranges are copied with memmove(), other alignments are 
+ * merged 64 bits at a time. Bits of dst outside the destination range are
+ * left untouched. dst and src may be the same stream with overlapping 
+ * ranges at any alignment, a copy to a later offset runs from the end of 
+ * the range backwards.
+ *
+ * @param [in,out] dst\n
+ * 	bit stream to copy the bits into
+ * @param [in] dstOffset\n
+ * 	offset in bits in dst at which the copy starts
+ * @param [in] src\n
+ * 	bit stream to copy the bits from
+ * @param [in] srcOffset\n
+ * 	offset in bits in src from which the copy starts
+ * @param [in] nbits\n
+ * 	number of bits to copy, clipped to what fits in both streams
+ * @returns number of bits copied
+ */
+uint64_t BitStreamCopyBits(BitStream* dst, uint64_t dstOffset, BitStream* src,
+	uint64_t srcOffset, uint64_t nbits) {
+
+   if (dst == NULL || src == NULL || dst->array == NULL || src->array == NULL)
+      return 0;
+
+   if (dstOffset > dst->nbits || srcOffset > src->nbits)
+      return 0;
+
+   nbits = MIN(nbits, dst->nbits - dstOffset);
+   nbits = MIN(nbits, src->nbits - srcOffset);
+
+   if (dst->array == src->array && dstOffset > srcOffset)
+      bitcopyback(dst->array, dstOffset, src->array, srcOffset, nbits);
+   else
+      bitcopy(dst->array, dstOffset, src->array, srcOffset, nbits);
+
+   return nbits;
+}
+
+/**
+ * @ingroup BitStream
+ * @fn uint64_t BitStreamFill(BitStream* bs, uint8_t byte) 
+ *
+ * @brief Fills the byte into bit stream
+ *
+ * @param [in,out] bs\n
+ * 	bit stream to fill data in
+ * @param [in] byte\n
+ * 	byte to be copied in the bitstream, a trailing partial byte of the 
+ * 	stream receives its most significant bits
+ * @returns number of bits copied into bit stream
+ */
+uint64_t BitStreamFill(BitStream* bs, uint8_t byte) {
+   uint64_t tail;
+
+   if (bs == NULL || bs->array == NULL)
+      return 0;
+
+   memset(bs->array, byte, bs->nbits / BITS_PER_BYTE);
+
+   tail = bs->nbits % BITS_PER_BYTE;
+   if (tail)
+      bitstore8(bs->array, bs->nbits - tail, byte >> (BITS_PER_BYTE - tail),
+		      tail);
+
+   return bs->nbits;
+}
+/**
+ * @ingroup BitStream
+ * @fn uint64_t BitStreamCopyHex(BitStream* bs, const char* inp)
+ *
+ * @brief fills the bytes from input HEX ascii buffer into bit stream
+ *
+ * @param [in,out] bs\n
+ * 	bit stream to fill data in
+ * @param [in] *inp\n
+ * 	pointer to the data to be copied, should be NULL terminated with valid
+ * 	hex charcters
+ * @returns number of bits copied into bit stream, 0 if the input is too
+ * 	large to be held in a bit stream or contains non hex characters
+ */
+uint64_t BitStreamCopyHex(BitStream* bs, const char* inp) {
+   return BitStreamCopyHexN(bs, inp, strlen(inp));
+}
+
+/**
+ * @ingroup BitStream
+ * @fn uint64_t BitStreamCopyHexN(BitStream* bs, const char* inp, size_t len)
+ *
+ * @brief Same as BitStreamCopyHex for len characters that need not be NULL
+ * 	terminated, such as a line returned by LineReaderNext
+ *
+ * @param [in,out] bs\n
+ * 	bit stream to fill data in
+ * @param [in] *inp\n
+ * 	pointer to the hex characters
+ * @param [in] len\n
+ * 	number of characters
+ * @returns number of bits copied into bit stream, 0 if the input is too
+ * 	large to be held in a bit stream or contains non hex characters
+ */
+uint64_t BitStreamCopyHexN(BitStream* bs, const char* inp, size_t len) {
+   
+   size_t size = len / 2 + len % 2;
+
+   if (size > BITSTREAM_MAX_BITS / BITS_PER_BYTE)
+      return 0;
+
+   if (bs) {
+      if (BitStreamRealloc(bs, NULL, (uint64_t)size * BITS_PER_BYTE))
+         return 0;
+
+      if (strtox(inp, len, bs->array) < 0)
+         return 0;
+   }
+   return (uint64_t)size * BITS_PER_BYTE;
+}
+
+/**
+ * @ingroup BitStream
+ * @fn uint64_t BitStreamCopyAscii(BitStream* bs, const char* inp)
+ *
+ * @brief fills the bytes from input ascii buffer into bit stream
+ *
+ * @param [in,out] bs\n
+ * 	bit stream to fill data in, should be NULL terminated
+ * @param [in] *inp\n
+ * 	pointer to the data to be copied
+ * @returns number of bits copied into bit stream
+ */
+uint64_t BitStreamCopyAscii(BitStream* bs, const char* inp) {
+   return BitStreamCopyAsciiN(bs, inp, strlen(inp));
+}
+
+/**
+ * @ingroup BitStream
+ * @fn uint64_t BitStreamCopyAsciiN(BitStream* bs, const char* inp, 
+ * 	size_t size)
+ *
+ * @brief Same as BitStreamCopyAscii for size characters that need not be 
+ * 	NULL terminated
+ *
+ * @param [in,out] bs\n
+ * 	bit stream to fill data in
+ * @param [in] *inp\n
+ * 	pointer to the data to be copied
+ * @param [in] size\n
+ * 	number of characters
+ * @returns number of bits copied into bit stream
+ */
+uint64_t BitStreamCopyAsciiN(BitStream* bs, const char* inp, size_t size) {
+   
+   uint64_t bitsCopied = 0;
+
+   if (size > BITSTREAM_MAX_BITS / BITS_PER_BYTE)
+      return 0;
+
+   if (bs) {
+      if (BitStreamRealloc(bs, NULL, (uint64_t)size * BITS_PER_BYTE) == 0 &&
+          bs->array != NULL)
+          bitsCopied = BitStreamCopy(bs, (const uint8_t *)inp, 
+			  (uint64_t)size * BITS_PER_BYTE);
+   }
+   return bitsCopied;
+}
+
+/**
+ * @ingroup BitStream
+ * @fn uint64_t BitStreamCopyBase64(BitStream* bs, const char* inp,\n
+ * 	uint32_t flags, size_t* errpos)
+ *
+ * @brief fills the bytes decoded from Base64 ascii buffer into bit stream
+ *
+ * Both padded and unpadded input is accepted
+ *
+ * @param [in,out] bs\n
+ * 	bit stream to fill data in, resized to the decoded length
+ * @param [in] *inp\n
+ * 	pointer to the Base64 characters, should be NULL terminated
+ * @param [in] flags\n
+ * 	BASE64_URLSAFE to decode the URL and filename safe alphabet,
+ * 	BASE64_SKIPSPACE to ignore white space such as line breaks
+ * @param [out] errpos\n
+ * 	if not NULL, receives the offset of the first invalid character when
+ * 	decoding fails (the input length if it ends mid quantum)
+ * @returns number of bits copied into bit stream, 0 on invalid input
+ */
+uint64_t BitStreamCopyBase64(BitStream* bs, const char* inp, uint32_t flags,
+	size_t* errpos) {
+   return BitStreamCopyBase64N(bs, inp, strlen(inp), flags, errpos);
+}
+
+/**
+ * @ingroup BitStream
+ * @fn uint64_t BitStreamCopyBase64N(BitStream* bs, const char* inp,\n
+ * 	size_t len, uint32_t flags, size_t* errpos)
+ *
+ * @brief Same as BitStreamCopyBase64 for len characters that need not be
+ * 	NULL terminated
+ *
+ * @param [in,out] bs\n
+ * 	bit stream to fill data in, resized to the decoded length
+ * @param [in] *inp\n
+ * 	pointer to the Base64 characters
+ * @param [in] len\n
+ * 	number of characters
+ * @param [in] flags\n
+ * 	BASE64_URLSAFE, BASE64_SKIPSPACE
+ * @param [out] errpos\n
+ * 	if not NULL, receives the offset of the first invalid character
+ * @returns number of bits copied into bit stream, 0 on invalid input
+ */
+uint64_t BitStreamCopyBase64N(BitStream* bs, const char* inp, size_t len,
+	uint32_t flags, size_t* errpos) {
+   int64_t size, tail;
+   Base64Decoder st;
+
+   if (bs == NULL || BASE64_DECODED_SIZE(len) > 
+		   BITSTREAM_MAX_BITS / BITS_PER_BYTE)
+      return 0;
+
+   if (BitStreamRealloc(bs, NULL, 
+			   (uint64_t)BASE64_DECODED_SIZE(len) * BITS_PER_BYTE))
+      return 0;
+
+   Base64DecoderInit(&st, flags);
+   size = base64decode(&st, inp, len, bs->array, errpos);
+   if (size < 0 || (tail = base64final(&st, bs->array + size, errpos)) < 0)
+      return 0;
+
+   size += tail;
+   if (size == 0)
+      return 0;
+
+   BitStreamRealloc(bs, NULL, (uint64_t)size * BITS_PER_BYTE);
+
+   return (uint64_t)size * BITS_PER_BYTE;
+}
+/**
+ * @ingroup BitStream
+ * @fn BitStream* BitStreamHex2Base64(BitStream *bs) 
+ *
+ * @brief converts input bitstream into a bitstream of RFC 4648 Base64 ascii
+ * 	characters, including '=' padding when the input is not a multiple 
+ * 	of 3 bytes
+ *
+ * @param [in] *bs\n
+ * 	pointer to bit stream for conversion
+ * @returns pointer to Base64 bit stream converted from input, NULL in case of
+ * 	any error
+ */
+BitStream* BitStreamHex2Base64(BitStream *bs) {
+   BitStream* out = NULL;
+   size_t     nbytes;
+
+   if (bs) {
+      nbytes = BITS_TO_BYTES(bs->nbits);
+      if (nbytes / 3 >= BITSTREAM_MAX_BITS / BITS_PER_BYTE / 4)
+         return NULL;
+
+      out = BitStreamCreate((uint64_t)BASE64_ENCODED_SIZE(nbytes) * 
+		      BITS_PER_BYTE);
+      if (out != NULL && nbytes)
+         base64encode_stream(bs, (char *)out->array);
+   }
+   return out;
+}
+
+/**
+ * @ingroup BitStream
+ * @fn uint64_t BitStreamToBase64(BitStream* bs, char* out, size_t size)
+ *
+ * @brief Writes the contents of bit stream as RFC 4648 Base64 characters 
+ * 	with '=' padding, the output is NULL terminated
+ *
+ * @param [in] bs\n
+ * 	bit stream to convert, a trailing partial byte is encoded with its
+ * 	unused bits as zero
+ * @param [out] out\n
+ * 	buffer receiving the characters, needs BASE64_ENCODED_SIZE(bytes) plus
+ * 	the terminating NULL
+ * @param [in] size\n
+ * 	size of the output buffer
+ * @returns number of characters written excluding the NULL, 0 if the output
+ * 	buffer is too small
+ */
+uint64_t BitStreamToBase64(BitStream* bs, char* out, size_t size) {
+   size_t nbytes, len = 0;
+
+   if (bs == NULL || out == NULL || size == 0)
+      return 0;
+
+   nbytes = BITS_TO_BYTES(bs->nbits);
+   if (nbytes > (size - 1) / 4 * 3)
+      return 0;
+
+   if (nbytes)
+      len = base64encode_stream(bs, out);
+   out[len] = '\0';
+
+   return len;
+}
+
+/**
+ * @ingroup BitStream
+ * @fn void HexEncoderInit(HexEncoder *enc, int upper)
+ *
+ * @brief Sets up an incremental HEX ascii encoder
+ *
+ * @param [out] enc\n
+ * 	encoder to initialise
+ * @param [in] upper\n
+ * 	non zero for upper case digits A-F, lower case otherwise
+ * @returns none
+ */
+void HexEncoderInit(HexEncoder *enc, int upper) {
+   enc->upper = upper;
+}
+
+/**
+ * @ingroup BitStream
+ * @fn size_t HexEncoderUpdate(HexEncoder *enc, const uint8_t *in,\n
+ * 	size_t len, char *out)
+ *
+ * @brief Encodes the next chunk of bytes, every byte is complete on its own
+ * 	so nothing is carried to the next chunk
+ *
+ * @param [in] enc\n
+ * 	encoder
+ * @param [in] in\n
+ * 	chunk of bytes to encode
+ * @param [in] len\n
+ * 	number of bytes in the chunk
+ * @param [out] out\n
+ * 	buffer of at least 2 * len characters, not NULL terminated
+ * @returns number of characters written
+ */
+size_t HexEncoderUpdate(HexEncoder *enc, const uint8_t *in, size_t len, 
+		char *out) {
+   hexencode(in, len, out, enc->upper);
+   return 2 * len;
+}
+
+/**
+ * @ingroup BitStream
+ * @fn void HexDecoderInit(HexDecoder *dec)
+ *
+ * @brief Sets up an incremental HEX ascii decoder
+ *
+ * Unlike BitStreamCopyHex the total length is not known up front, so an
+ * odd number of characters is an error rather than an implied leading '0'
+ *
+ * @param [out] dec\n
+ * 	decoder to initialise
+ * @returns none
+ */
+void HexDecoderInit(HexDecoder *dec) {
+   dec->nibble = -1;
+   dec->offset = 0;
+}
+
+/**
+ * @ingroup BitStream
+ * @fn int64_t HexDecoderUpdate(HexDecoder *dec, const char *in,\n
+ * 	size_t len, uint8_t *out, size_t *errpos)
+ *
+ * @brief Decodes the next chunk of HEX ascii characters, a trailing odd
+ * 	digit is carried over to the next chunk
+ *
+ * @param [in,out] dec\n
+ * 	decoder
+ * @param [in] in\n
+ * 	chunk of characters, need not be terminated
+ * @param [in] len\n
+ * 	number of characters in the chunk
+ * @param [out] out\n
+ * 	buffer of at least len / 2 + 1 bytes
+ * @param [out] errpos\n
+ * 	if not NULL, receives the offset from the start of the input of the
+ * 	first invalid character
+ * @returns number of bytes decoded, -1 on invalid input
+ */
+int64_t HexDecoderUpdate(HexDecoder *dec, const char *in, size_t len, 
+		uint8_t *out, size_t *errpos) {
+   size_t i = 0, j = 0, even;
+   int    v;
+
+   if (len && dec->nibble >= 0) {
+      if ((v = xtoi(in[0])) < 0)
+         goto invalid;
+      out[j++] = (uint8_t)(dec->nibble << 4 | v);
+      dec->nibble = -1;
+      i = 1;
+   }
+
+   even = (len - i) & ~(size_t)1;
+   if (strtox(in + i, even, out + j) < 0) {
+      while (xtoi(in[i]) >= 0)
+         i++;
+      goto invalid;
+   }
+   i += even;
+   j += even / 2;
+
+   if (i < len) {
+      if ((v = xtoi(in[i])) < 0)
+         goto invalid;
+      dec->nibble = v;
+   }
+
+   dec->offset += len;
+   return (int64_t)j;
+
+invalid:
+   if (errpos)
+      *errpos = dec->offset + i;
+   return (-1);
+}
+
+/**
+ * @ingroup BitStream
+ * @fn int HexDecoderFinal(HexDecoder *dec, size_t *errpos)
+ *
+ * @brief Ends the input of the decoder
+ *
+ * @param [in,out] dec\n
+ * 	decoder
+ * @param [out] errpos\n
+ * 	if not NULL, receives the input length when a digit is left over
+ * @returns 0 on success, -1 if the input had an odd number of digits
+ */
+int HexDecoderFinal(HexDecoder *dec, size_t *errpos) {
+   if (dec->nibble >= 0) {
+      if (errpos)
+         *errpos = dec->offset;
+      return (-1);
+   }
+   return 0;
+}
+
+/**
+ * @ingroup BitStream
+ * @fn void Base64EncoderInit(Base64Encoder *enc)
+ *
+ * @brief Sets up an incremental RFC 4648 Base64 encoder
+ *
+ * @param [out] enc\n
+ * 	encoder to initialise
+ * @returns none
+ */
+void Base64EncoderInit(Base64Encoder *enc) {
+   enc->ncarry = 0;
+}
+
+/**
+ * @ingroup BitStream
+ * @fn size_t Base64EncoderUpdate(Base64Encoder *enc, const uint8_t *in,\n
+ * 	size_t len, char *out)
+ *
+ * @brief Encodes the next chunk of bytes, up to 2 bytes of an incomplete
+ * 	3 byte group are carried over to the next chunk
+ *
+ * @param [in,out] enc\n
+ * 	encoder
+ * @param [in] in\n
+ * 	chunk of bytes to encode
+ * @param [in] len\n
+ * 	number of bytes in the chunk
+ * @param [out] out\n
+ * 	buffer of at least BASE64_ENCODED_SIZE(len) characters, not NULL 
+ * 	terminated
+ * @returns number of characters written
+ */
+size_t Base64EncoderUpdate(Base64Encoder *enc, const uint8_t *in, size_t len,
+		char *out) {
+   uint8_t group[3];
+   size_t  i = 0, o = 0, full;
+
+   if (enc->ncarry) {
+      memcpy(group, enc->carry, enc->ncarry);
+      while (enc->ncarry < 3 && i < len)
+         group[enc->ncarry++] = in[i++];
+      if (enc->ncarry < 3) {
+         memcpy(enc->carry, group, enc->ncarry);
+         return 0;
+      }
+      o = base64encode(group, 3, out);
+   }
+
+   full = (len - i) / 3 * 3;
+   o += base64encode(in + i, full, out + o);
+   i += full;
+
+   enc->ncarry = (uint32_t)(len - i);
+   memcpy(enc->carry, in + i, enc->ncarry);
+
+   return o;
+}
+
+/**
+ * @ingroup BitStream
+ * @fn size_t Base64EncoderFinal(Base64Encoder *enc, char *out)
+ *
+ * @brief Encodes the carried bytes with '=' padding
+ *
+ * @param [in,out] enc\n
+ * 	encoder, ready for a new input afterwards
+ * @param [out] out\n
+ * 	buffer of at least 4 characters, not NULL terminated
+ * @returns number of characters written
+ */
+size_t Base64EncoderFinal(Base64Encoder *enc, char *out) {
+   size_t o = base64encode(enc->carry, enc->ncarry, out);
+
+   enc->ncarry = 0;
+   return o;
+}
+
+/**
+ * @ingroup BitStream
+ * @fn void Base64DecoderInit(Base64Decoder *dec, uint32_t flags)
+ *
+ * @brief Sets up an incremental Base64 decoder
+ *
+ * @param [out] dec\n
+ * 	decoder to initialise
+ * @param [in] flags\n
+ * 	BASE64_URLSAFE, BASE64_SKIPSPACE, see BitStreamCopyBase64
+ * @returns none
+ */
+void Base64DecoderInit(Base64Decoder *dec, uint32_t flags) {
+   dec->flags  = flags;
+   dec->acc    = 0;
+   dec->n      = 0;
+   dec->pad    = 0;
+   dec->offset = 0;
+}
+
+/**
+ * @ingroup BitStream
+ * @fn int64_t Base64DecoderUpdate(Base64Decoder *dec, const char *in,\n
+ * 	size_t len, uint8_t *out, size_t *errpos)
+ *
+ * @brief Decodes the next chunk of Base64 characters, up to 3 characters of
+ * 	an incomplete quantum are carried over to the next chunk
+ *
+ * @param [in,out] dec\n
+ * 	decoder
+ * @param [in] in\n
+ * 	chunk of characters, need not be terminated
+ * @param [in] len\n
+ * 	number of characters in the chunk
+ * @param [out] out\n
+ * 	buffer of at least BASE64_DECODED_SIZE(len + 3) bytes
+ * @param [out] errpos\n
+ * 	if not NULL, receives the offset from the start of the input of the
+ * 	first invalid character
+ * @returns number of bytes decoded, -1 on invalid input
+ */
+int64_t Base64DecoderUpdate(Base64Decoder *dec, const char *in, size_t len,
+		uint8_t *out, size_t *errpos) {
+   return base64decode(dec, in, len, out, errpos);
+}
+
+/**
+ * @ingroup BitStream
+ * @fn int64_t Base64DecoderFinal(Base64Decoder *dec, uint8_t *out,\n
+ * 	size_t *errpos)
+ *
+ * @brief Ends the input of the decoder, decoding the bytes of a final
+ * 	unpadded quantum
+ *
+ * @param [in,out] dec\n
+ * 	decoder
+ * @param [out] out\n
+ * 	buffer of at least 2 bytes
+ * @param [out] errpos\n
+ * 	if not NULL, receives the input length when the input ends with an
+ * 	incomplete quantum or padding
+ * @returns number of bytes decoded, -1 on invalid input
+ */
+int64_t Base64DecoderFinal(Base64Decoder *dec, uint8_t *out, size_t *errpos) {
+   return base64final(dec, out, errpos);
+}
+
+#if defined(BITSTREAM_X86)
+/**
+ * @fn size_t memxor_avx2(uint8_t *dst, const uint8_t *a, const uint8_t *b,\n
+ * 	size_t n)
+ *
+ * @brief XORs 64 bytes per iteration with two 256 bit lanes in flight
+ *
+ * @returns number of bytes processed, a multiple of 32
+ */
+__attribute__((target("avx2")))
+static size_t memxor_avx2(uint8_t *dst, const uint8_t *a, const uint8_t *b, 
+		size_t n) {
+    size_t i = 0;
+
+    for (; i + 64 <= n; i += 64) {
+       __m256i x0 = _mm256_loadu_si256((const __m256i *)(a + i));
+       __m256i x1 = _mm256_loadu_si256((const __m256i *)(a + i + 32));
+       __m256i y0 = _mm256_loadu_si256((const __m256i *)(b + i));
+       __m256i y1 = _mm256_loadu_si256((const __m256i *)(b + i + 32));
+
+       _mm256_storeu_si256((__m256i *)(dst + i), _mm256_xor_si256(x0, y0));
+       _mm256_storeu_si256((__m256i *)(dst + i + 32), 
+		       _mm256_xor_si256(x1, y1));
+    }
+    for (; i + 32 <= n; i += 32)
+       _mm256_storeu_si256((__m256i *)(dst + i), _mm256_xor_si256(
+			       _mm256_loadu_si256((const __m256i *)(a + i)),
+			       _mm256_loadu_si256((const __m256i *)(b + i))));
+    return i;
+}
+
+/**
+ * @fn size_t memxor_avx512(uint8_t *dst, const uint8_t *a,\n
+ * 	const uint8_t *b, size_t n)
+ *
+ * @brief XORs 64 bytes per iteration, the tail below 64 bytes is done with
+ * 	a masked load and store
+ *
+ * @returns number of bytes processed, always n
+ */
+__attribute__((target("avx512f,avx512bw")))
+static size_t memxor_avx512(uint8_t *dst, const uint8_t *a, const uint8_t *b,
+		size_t n) {
+    size_t i = 0;
+    __mmask64 m;
+
+    for (; i + 64 <= n; i += 64)
+       _mm512_storeu_si512(dst + i, _mm512_xor_si512(
+			       _mm512_loadu_si512(a + i), 
+			       _mm512_loadu_si512(b + i)));
+    if (i < n) {
+       m = ~0ULL >> (64 - (n - i));
+       _mm512_mask_storeu_epi8(dst + i, m, _mm512_xor_si512(
+			       _mm512_maskz_loadu_epi8(m, a + i), 
+			       _mm512_maskz_loadu_epi8(m, b + i)));
+    }
+    return n;
+}
+#endif /* BITSTREAM_X86 */
+
+/**
+ * @fn void memxor(uint8_t *dst, const uint8_t *a, const uint8_t *b,\n
+ * 	size_t n)
+ *
+ * @brief dst = a ^ b over n bytes, dst may be the same buffer as a or b
+ *
+ * Uses the widest SIMD kernel the cpu supports, the remainder is done 8
+ * bytes at a time and then byte by byte
+ */
+static void memxor(uint8_t *dst, const uint8_t *a, const uint8_t *b, 
+		size_t n) {
+    size_t   i = 0;
+    uint64_t x, y;
+#if defined(BITSTREAM_X86)
+    uint32_t cpu = cpu_features();
+
+    if (cpu & CPU_AVX512BW)
+       i = memxor_avx512(dst, a, b, n);
+    else if (cpu & CPU_AVX2)
+       i = memxor_avx2(dst, a, b, n);
+#endif
+
+    for (; i + 8 <= n; i += 8) {
+       memcpy(&x, a + i, 8);
+       memcpy(&y, b + i, 8);
+       x ^= y;
+       memcpy(dst + i, &x, 8);
+    }
+    for (; i < n; i++)
+       dst[i] = a[i] ^ b[i];
+}
+
+/**
+ * @fn int xorrepeat(uint8_t *dst, const uint8_t *src, uint64_t nbits,\n
+ * 	const uint8_t *key, uint64_t keybits)
+ *
+ * @brief dst = src ^ key repeated, over nbits bits starting at bit 0
+ *
+ * The key is expanded once into a pattern holding a whole number of key
+ * periods, the period being the smallest number of bytes after which the
+ * key starts again on a byte boundary (keybits / gcd(keybits, 8) bytes).
+ * The pattern is grown to at least XOR_PATTERN_BYTES so that the data can
+ * be streamed through memxor() in long runs without any per byte modulo.
+ * Keys of any bit length are handled, unused bits of a trailing partial
+ * byte of dst are cleared.
+ *
+ * @param [out] dst\n
+ * 	result buffer, may be the same as src
+ * @param [in] src\n
+ * 	data to xor
+ * @param [in] nbits\n
+ * 	number of bits of data
+ * @param [in] key\n
+ * 	key to repeat over the data
+ * @param [in] keybits\n
+ * 	length of the key in bits, non zero
+ * @returns 0 on success, -1 if the pattern could not be allocated
+ */
+static int xorrepeat(uint8_t *dst, const uint8_t *src, uint64_t nbits, 
+		const uint8_t *key, uint64_t keybits) {
+    uint8_t  local[XOR_PATTERN_BYTES];
+    uint8_t  *pat = local;
+    size_t   nbytes = BITS_TO_BYTES(nbits);
+    size_t   period, block, i;
+    uint64_t k, g;
+
+    if (keybits >= nbits) {
+       memxor(dst, src, key, nbytes);
+    } else {
+       g = MIN(keybits & (~keybits + 1), BITS_PER_BYTE);
+       period = keybits / g;
+       block  = period < XOR_PATTERN_BYTES / 2 ? 
+	       XOR_PATTERN_BYTES / period * period : period;
+       block  = MIN(block, nbytes);
+
+       if (block > XOR_PATTERN_BYTES && (pat = malloc(block)) == NULL)
+          return (-1);
+
+       for (k = 0; k < (uint64_t)block * BITS_PER_BYTE; k += keybits)
+          bitcopy(pat, k, key, 0, 
+			  MIN(keybits, (uint64_t)block * BITS_PER_BYTE - k));
+
+       for (i = 0; i < nbytes; i += block)
+          memxor(dst + i, src + i, pat, MIN(block, nbytes - i));
+
+       if (pat != local)
+          free(pat);
+    }
+
+    if (nbits % BITS_PER_BYTE)
+       dst[nbytes - 1] &= 0xFF << (BITS_PER_BYTE - nbits % BITS_PER_BYTE);
+
+    return 0;
+}
+
+/**
+ * @ingroup BitStream
+ * @fn BitStream* BitStreamExclusiveOr(BitStream *bx, BitStream *by) 
+ *
+ * @brief Performs exclusive OR of bitstream bx against bitstream by and returns
+ *	bitstream bz
+ *
+ * If the size of bx is larger than size of by, by rolls over to continue xor
+ * operation, for keys of any length in bits. The routine allocates a new 
+ * object of type BitStream and returns pointer to the same
+ *
+ * The key is expanded once into a repeating pattern and the data is xored
+ * against it with the SIMD xor kernel, see xorrepeat()
+ *
+ * @param [in] *bx\n
+ *   	Bitstream x
+ * @param [in] *by\n
+ *   	Bitstream y
+ * @returns Pointer to object of type BitStream holding the result of xor 
+ * 	operation explained above
+ */
+BitStream* BitStreamExclusiveOr(BitStream *bx, BitStream *by) {
+   BitStream* bz = NULL;
+
+   if (bx && by && by->nbits) {
+      bz = BitStreamCreate(bx->nbits);
+      if (bz && bx->nbits && 
+          xorrepeat(bz->array, bx->array, bx->nbits, by->array, by->nbits)) {
+         BitStreamDelete(bz);
+         bz = NULL;
+      }
+   }
+   return bz;
+}
+
+/**
+ * @ingroup BitStream
+ * @fn uint64_t BitStreamXorInto(BitStream *dst, BitStream *bx,\n
+ * 	BitStream *by)
+ *
+ * @brief Same as BitStreamExclusiveOr but the result goes into a caller
+ * 	owned bit stream instead of a newly allocated one
+ *
+ * dst is only reallocated when its size differs from bx, so reusing the
+ * same dst across calls of equal size does no allocation at all
+ *
+ * @param [in,out] dst\n
+ *   	Bitstream receiving bx ^ by, may be bx itself, or by itself when by
+ *   	is as long as bx (a shorter by would be resized before use as key)
+ * @param [in] *bx\n
+ *   	Bitstream x
+ * @param [in] *by\n
+ *   	Bitstream y, rolled over when shorter than bx
+ * @returns number of bits in the result, 0 on failure
+ */
+uint64_t BitStreamXorInto(BitStream *dst, BitStream *bx, BitStream *by) {
+
+   if (dst == NULL || bx == NULL || by == NULL || by->nbits == 0 ||
+       (dst == by && by->nbits != bx->nbits))
+      return 0;
+
+   if (dst->nbits != bx->nbits && BitStreamRealloc(dst, NULL, bx->nbits))
+      return 0;
+
+   if (bx->nbits == 0 || 
+       xorrepeat(dst->array, bx->array, bx->nbits, by->array, by->nbits))
+      return 0;
+
+   return bx->nbits;
+}
+
+/**
+ * @ingroup BitStream
+ * @fn uint64_t BitStreamXorInPlace(BitStream *bx, BitStream *by)
+ *
+ * @brief Exclusive OR of bitstream by into bitstream bx, by rolls over when
+ * 	shorter than bx
+ *
+ * @param [in,out] *bx\n
+ *   	Bitstream x, overwritten with the result
+ * @param [in] *by\n
+ *   	Bitstream y
+ * @returns number of bits in the result, 0 on failure
+ */
+uint64_t BitStreamXorInPlace(BitStream *bx, BitStream *by) {
+   return BitStreamXorInto(bx, bx, by);
+}
+
+/**
+ * @var english_logprob
+ * @brief natural log of the probability of each byte value in English
+ * 	prose: letter frequencies, one space per ~5.5 characters, a little
+ * 	punctuation and a floor for everything unprintable
+ */
+static const float english_logprob[256] = {
+   -18.35, -18.35, -18.35, -18.35, -18.35, -18.35, -18.35, -18.35,
+   -18.35,  -9.14,  -5.74, -18.35, -18.35,  -9.14, -18.35, -18.35,
+   -18.35, -18.35, -18.35, -18.35, -18.35, -18.35, -18.35, -18.35,
+   -18.35, -18.35, -18.35, -18.35, -18.35, -18.35, -18.35, -18.35,
+    -1.83,  -7.53,  -6.15,  -9.84,  -9.84,  -9.84,  -9.84,  -5.74,
+    -9.84,  -9.84,  -9.84,  -9.84,  -4.54,  -6.44,  -4.64,  -9.84,
+    -7.53,  -7.53,  -7.53,  -7.53,  -7.53,  -7.53,  -7.53,  -7.53,
+    -7.53,  -7.53,  -7.53,  -7.53,  -9.84,  -9.84,  -9.84,  -7.53,
+    -9.84,  -5.94,  -7.79,  -7.02,  -6.60,  -5.50,  -7.24,  -7.34,
+    -6.24,  -6.10,  -9.94,  -8.31,  -6.65,  -7.17,  -6.14,  -6.03,
+    -7.39, -10.35,  -6.25,  -6.20,  -5.84,  -7.03,  -8.07,  -7.19,
+    -9.94,  -7.37, -10.70,  -9.84,  -9.84,  -9.84,  -9.84,  -9.84,
+    -9.84,  -2.77,  -4.61,  -3.84,  -3.42,  -2.33,  -4.07,  -4.16,
+    -3.06,  -2.93,  -6.76,  -5.13,  -3.47,  -3.99,  -2.96,  -2.85,
+    -4.21,  -7.17,  -3.08,  -3.02,  -2.66,  -3.85,  -4.89,  -4.01,
+    -6.76,  -4.19,  -7.53,  -9.84,  -9.84,  -9.84,  -9.84, -18.35,
+   -18.35, -18.35, -18.35, -18.35, -18.35, -18.35, -18.35, -18.35,
+   -18.35, -18.35, -18.35, -18.35, -18.35, -18.35, -18.35, -18.35,
+   -18.35, -18.35, -18.35, -18.35, -18.35, -18.35, -18.35, -18.35,
+   -18.35, -18.35, -18.35, -18.35, -18.35, -18.35, -18.35, -18.35,
+   -18.35, -18.35, -18.35, -18.35, -18.35, -18.35, -18.35, -18.35,
+   -18.35, -18.35, -18.35, -18.35, -18.35, -18.35, -18.35, -18.35,
+   -18.35, -18.35, -18.35, -18.35, -18.35, -18.35, -18.35, -18.35,
+   -18.35, -18.35, -18.35, -18.35, -18.35, -18.35, -18.35, -18.35,
+   -18.35, -18.35, -18.35, -18.35, -18.35, -18.35, -18.35, -18.35,
+   -18.35, -18.35, -18.35, -18.35, -18.35, -18.35, -18.35, -18.35,
+   -18.35, -18.35, -18.35, -18.35, -18.35, -18.35, -18.35, -18.35,
+   -18.35, -18.35, -18.35, -18.35, -18.35, -18.35, -18.35, -18.35,
+   -18.35, -18.35, -18.35, -18.35, -18.35, -18.35, -18.35, -18.35,
+   -18.35, -18.35, -18.35, -18.35, -18.35, -18.35, -18.35, -18.35,
+   -18.35, -18.35, -18.35, -18.35, -18.35, -18.35, -18.35, -18.35,
+   -18.35, -18.35, -18.35, -18.35, -18.35, -18.35, -18.35, -18.35
+};
+
+/**
+ * @fn static void bytehistogram(const uint8_t *buf, size_t n, 
+ * 	uint32_t hist[256])
+ *
+ * @brief Counts byte values of buf into hist
+ *
+ * Four interleaved sub histograms keep runs of the same byte from
+ * serialising on one counter
+ *
+ * @param [in] buf\n
+ * 	bytes to count
+ * @param [in] n\n
+ * 	number of bytes
+ * @param [out] hist\n
+ * 	count of every byte value
+ */
+static void bytehistogram(const uint8_t *buf, size_t n, uint32_t hist[256]) {
+    uint32_t h[4][256];
+    size_t   i;
+    int      b;
+
+    memset(h, 0, sizeof(h));
+    for (i = 0; i + 4 <= n; i += 4) {
+       h[0][buf[i]] ++;
+       h[1][buf[i + 1]] ++;
+       h[2][buf[i + 2]] ++;
+       h[3][buf[i + 3]] ++;
+    }
+    for (; i < n; i++)
+       h[0][buf[i]] ++;
+
+    for (b = 0; b < 256; b++)
+       hist[b] = h[0][b] + h[1][b] + h[2][b] + h[3][b];
+}
+
+/**
+ * @def HISTOGRAM_CHUNK
+ * @brief largest number of bytes counted into one uint32_t histogram
+ */
+#define HISTOGRAM_CHUNK	((size_t)1 << 30)
+
+/**
+ * @fn static void xorscores_scalar(const uint32_t hist[256], float out[256])
+ *
+ * @brief out[k] = sum over b of hist[b] * english_logprob[b ^ k], visiting
+ * 	only the byte values that occur
+ */
+static void xorscores_scalar(const uint32_t hist[256], float out[256]) {
+    uint8_t used[256];
+    int     nused = 0, b, i, k;
+    double  sum;
+
+    for (b = 0; b < 256; b++) 
+       if (hist[b])
+          used[nused++] = b;
+
+    for (k = 0; k < 256; k++) {
+       sum = 0;
+       for (i = 0; i < nused; i++)
+          sum += hist[used[i]] * english_logprob[used[i] ^ k];
+       out[k] = sum;
+    }
+}
+
+#if defined(BITSTREAM_X86)
+/**
+ * @fn static void xorscores_avx2(const uint32_t hist[256], float out[256])
+ *
+ * @brief AVX2 xorscores_scalar() without gathers
+ *
+ * Every byte value b that occurs adds hist[b] times the table permuted by
+ * b to the scores of all keys. Write b = 8 * bh + bl: XOR by bl swaps
+ * lanes inside every 8 lane block of the table (one vpermps per block),
+ * XOR by bh swaps whole blocks, which is only a different register. The
+ * 32 key accumulators are independent so the multiply adds pipeline
+ */
+__attribute__((target("avx2")))
+static void xorscores_avx2(const uint32_t hist[256], float out[256]) {
+    __m256  lp[32], acc[32], c;
+    __m256i lane, idx;
+    int     b, bh, j;
+
+    lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    for (j = 0; j < 32; j++) {
+       lp[j]  = _mm256_loadu_ps(english_logprob + 8 * j);
+       acc[j] = _mm256_setzero_ps();
+    }
+
+    for (b = 0; b < 256; b++) {
+       if (hist[b] == 0)
+          continue;
+       c   = _mm256_set1_ps((float)hist[b]);
+       idx = _mm256_xor_si256(lane, _mm256_set1_epi32(b & 7));
+       bh  = b >> 3;
+       for (j = 0; j < 32; j++)
+          acc[j] = _mm256_add_ps(acc[j], _mm256_mul_ps(c, 
+			  _mm256_permutevar8x32_ps(lp[j ^ bh], idx)));
+    }
+
+    for (j = 0; j < 32; j++)
+       _mm256_storeu_ps(out + 8 * j, acc[j]);
+}
+#endif
+
+/**
+ * @fn static void xorscores(const uint32_t hist[256], float out[256])
+ *
+ * @brief xorscores_scalar() on the fastest kernel the cpu supports
+ */
+static void xorscores(const uint32_t hist[256], float out[256]) {
+#if defined(BITSTREAM_X86)
+    if (cpu_features() & CPU_AVX2) {
+       xorscores_avx2(hist, out);
+       return;
+    }
+#endif
+    xorscores_scalar(hist, out);
+}
+
+/**
+ * @fn static void textscores(const uint8_t *buf, size_t n, float out[256])
+ *
+ * @brief English score of buf ^ k for every single byte key k, as mean log 
+ * 	probability per byte
+ *
+ * @param [in] buf\n
+ * 	bytes to score, n > 0
+ * @param [in] n\n
+ * 	number of bytes
+ * @param [out] out\n
+ * 	score of every key
+ */
+static void textscores(const uint8_t *buf, size_t n, float out[256]) {
+    uint32_t hist[256];
+    float    part[256];
+    double   sum[256] = { 0 };
+    size_t   i, len;
+    int      k;
+
+    for (i = 0; i < n; i += len) {
+       len = MIN(n - i, HISTOGRAM_CHUNK);
+       bytehistogram(buf + i, len, hist);
+       xorscores(hist, part);
+       for (k = 0; k < 256; k++)
+          sum[k] += part[k];
+    }
+    for (k = 0; k < 256; k++)
+       out[k] = sum[k] / n;
+}
+
+/**
+ * @ingroup BitStream
+ * @fn float EnglishScore(const uint8_t *buf, size_t n)
+ *
+ * @brief Scores how much buf looks like English prose
+ *
+ * The score is the mean natural log probability per byte under a unigram
+ * model of English bytes, so it ranks texts of any length against each 
+ * other; higher is more English. Plain prose scores around -3, random bytes
+ * below -10
+ *
+ * @param [in] buf\n
+ * 	text to score
+ * @param [in] n\n
+ * 	number of bytes
+ * @returns the score, -FLT_MAX for an empty buffer
+ */
+float EnglishScore(const uint8_t *buf, size_t n) {
+   uint32_t hist[256];
+   double   sum = 0;
+   size_t   i, len;
+   int      b;
+
+   if (buf == NULL || n == 0)
+      return -FLT_MAX;
+
+   /* only the identity key, no need for the table of textscores() */
+   for (i = 0; i < n; i += len) {
+      len = MIN(n - i, HISTOGRAM_CHUNK);
+      bytehistogram(buf + i, len, hist);
+      for (b = 0; b < 256; b++)
+         sum += (double)hist[b] * english_logprob[b];
+   }
+   return (float)(sum / n);
+}
+
+/**
+ * @ingroup BitStream
+ * @fn float BitStreamEnglishScore(BitStream *bs)
+ *
+ * @brief EnglishScore of the whole bytes of bitstream bs
+ *
+ * @param [in] *bs\n
+ * 	bitstream to score
+ * @returns the score, -FLT_MAX when bs holds no whole byte
+ */
+float BitStreamEnglishScore(BitStream *bs) {
+   if (bs == NULL)
+      return -FLT_MAX;
+   return EnglishScore(bs->array, bs->nbits / BITS_PER_BYTE);
+}
+
+/**
+ * @ingroup BitStream
+ * @fn int BitStreamRankXorKeys(BitStream *bs, XorKeyScore *best, int n)
+ *
+ * @brief Ranks all 256 single byte XOR keys of bs by how English the
+ * 	decrypted text looks and returns the n best
+ *
+ * XOR with a constant only permutes byte values, so one histogram of bs
+ * scores every key without decrypting: score(k) is the EnglishScore of
+ * bs ^ k, computed from the histogram alone. Only whole bytes of bs take
+ * part
+ *
+ * @param [in] *bs\n
+ * 	cipher text
+ * @param [out] *best\n
+ * 	array of at least n entries, filled best key first
+ * @param [in] n\n
+ * 	number of keys wanted, at most 256 are returned
+ * @returns number of entries filled, -1 on error
+ */
+int BitStreamRankXorKeys(BitStream *bs, XorKeyScore *best, int n) {
+   float    scores[256];
+   size_t   nbytes;
+   int      filled = 0;
+   int      i, k;
+
+   if (bs == NULL || best == NULL || n < 0)
+      return (-1);
+
+   nbytes = bs->nbits / BITS_PER_BYTE;
+   n = MIN(n, 256);
+   if (nbytes == 0 || n == 0)
+      return 0;
+
+   textscores(bs->array, nbytes, scores);
+
+   for (k = 0; k < 256; k++) {
+      /* insertion into the sorted best list, ties keep the lower key */
+      if (filled == n && scores[k] <= best[n - 1].score)
+         continue;
+      i = filled < n ? filled++ : n - 1;
+      for (; i > 0 && best[i - 1].score < scores[k]; i--)
+         best[i] = best[i - 1];
+      best[i].key   = k;
+      best[i].score = scores[k];
+   }
+   return filled;
+}
+
+/**
+ * @ingroup BitStream
+ * @fn int LineReaderOpen(LineReader *lr, const char *path)
+ *
+ * @brief Maps the file read only so LineReaderNext can hand out its lines
+ * 	in place, without copying them or limiting their length
+ *
+ * @param [out] *lr\n
+ * 	line reader to initialise, release it with LineReaderClose
+ * @param [in] *path\n
+ * 	file to read
+ * @returns 0 on success, -1 if the file cannot be opened or mapped
+ */
+int LineReaderOpen(LineReader *lr, const char *path) {
+   struct stat st;
+   void        *map = NULL;
+   int         fd;
+
+   if (lr == NULL || path == NULL)
+      return (-1);
+
+   fd = open(path, O_RDONLY);
+   if (fd < 0)
+      return (-1);
+
+   if (fstat(fd, &st) || (uint64_t)st.st_size > SIZE_MAX) {
+      close(fd);
+      return (-1);
+   }
+
+   if (st.st_size > 0) {
+      map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (map == MAP_FAILED) {
+         close(fd);
+         return (-1);
+      }
+      madvise(map, st.st_size, MADV_SEQUENTIAL);
+   }
+   close(fd); /* the mapping outlives the descriptor */
+
+   lr->data   = map;
+   lr->size   = st.st_size;
+   lr->offset = 0;
+
+   return 0;
+}
+
+/**
+ * @ingroup BitStream
+ * @fn int LineReaderNext(LineReader *lr, const char **line, size_t *len)
+ *
+ * @brief Returns the next line of the file as a view into the mapping
+ *
+ * The line is not NULL terminated, its '\n' or "\r\n" is left out of len.
+ * A last line without line break is returned as well. The view stays 
+ * valid until LineReaderClose
+ *
+ * @param [in,out] *lr\n
+ * 	line reader opened with LineReaderOpen
+ * @param [out] **line\n
+ * 	first character of the line
+ * @param [out] *len\n
+ * 	number of characters in the line
+ * @returns 1 if a line was returned, 0 at the end of the file
+ */
+int LineReaderNext(LineReader *lr, const char **line, size_t *len) {
+   const char *p, *eol;
+   size_t     n;
+
+   if (lr == NULL || lr->offset >= lr->size)
+      return 0;
+
+   p   = lr->data + lr->offset;
+   eol = memchr(p, '\n', lr->size - lr->offset);
+   n   = eol ? (size_t)(eol - p) : lr->size - lr->offset;
+
+   lr->offset += n + (eol != NULL);
+   if (n && p[n - 1] == '\r')
+      n --;
+
+   *line = p;
+   *len  = n;
+   return 1;
+}
+
+/**
+ * @ingroup BitStream
+ * @fn void LineReaderClose(LineReader *lr)
+ *
+ * @brief Unmaps the file, lines returned by LineReaderNext become invalid
+ *
+ * @param [in,out] *lr\n
+ * 	line reader opened with LineReaderOpen
+ */
+void LineReaderClose(LineReader *lr) {
+   if (lr != NULL) {
+      if (lr->data != NULL)
+         munmap((void *)lr->data, lr->size);
+      lr->data   = NULL;
+      lr->size   = 0;
+      lr->offset = 0;
+   }
+}
+
+/**
+ * @fn static int reserve(BitStream *bs, uint64_t nbits)
+ *
+ * @brief Makes room for nbits bits without changing the size of bs
+ *
+ * The capacity at least doubles on every growth so a sequence of appends 
+ * costs amortised O(1) per bit
+ *
+ * @returns 0 on success, -1 if nbits is out of range or allocation fails
+ */
+static int reserve(BitStream *bs, uint64_t nbits) {
+    size_t  bytes = BITS_TO_BYTES(nbits);
+    size_t  cap;
+    uint8_t *array;
+
+    if (nbits > BITSTREAM_MAX_BITS)
+       return (-1);
+    if (bytes <= bs->capacity)
+       return 0;
+
+    cap = bs->capacity < BITSTREAM_MAX_BITS / BITS_PER_BYTE / 2 ?
+	    2 * bs->capacity : BITSTREAM_MAX_BITS / BITS_PER_BYTE;
+    cap = cap > bytes ? cap : bytes;
+    cap = cap > 2 * BITSTREAM_INLINE_BYTES ? cap : 2 * BITSTREAM_INLINE_BYTES;
+
+    if (OWNS_ARRAY(bs)) {
+       array = (uint8_t *)realloc(bs->array, cap);
+       if (array == NULL)
+          return (-1);
+    } else {
+       array = (uint8_t *)malloc(cap);
+       if (array == NULL)
+          return (-1);
+       if (bs->nbits)
+          memcpy(array, bs->array, BITS_TO_BYTES(bs->nbits));
+    }
+
+    bs->array    = array;
+    bs->capacity = cap;
+    bs->flags   &= ~(BITSTREAM_BORROWED | BITSTREAM_INLINE);
+
+    return 0;
+}
+
+/**
+ * @fn static void cleartail(BitStream *bs)
+ *
+ * @brief clears the bits of the last byte of bs past its end
+ */
+static inline void cleartail(BitStream *bs) {
+    if (bs->nbits % BITS_PER_BYTE)
+       bs->array[bs->nbits / BITS_PER_BYTE] &= 
+	       0xFF << (BITS_PER_BYTE - bs->nbits % BITS_PER_BYTE);
+}
+
+/**
+ * @ingroup BitStream
+ * @fn uint64_t BitStreamAppendBits(BitStream *bs, uint64_t value, 
+ * 	uint32_t nbits, BitStreamOrder order)
+ *
+ * @brief Appends an nbits field to the end of bs, growing it as needed
+ *
+ * The field is laid out as by BitStreamPutBits
+ *
+ * @param [in,out] *bs\n
+ * 	bit stream to append to
+ * @param [in] value\n
+ * 	field value, its low nbits bits are used
+ * @param [in] nbits\n
+ * 	width of the field, 1 to 64
+ * @param [in] order\n
+ * 	BITSTREAM_MSB_FIRST or BITSTREAM_LSB_FIRST
+ * @returns number of bits appended, 0 on error
+ */
+uint64_t BitStreamAppendBits(BitStream *bs, uint64_t value, uint32_t nbits,
+		BitStreamOrder order) {
+   uint64_t offset;
+
+   if (bs == NULL || nbits == 0 || nbits > 64 || 
+       reserve(bs, bs->nbits + nbits))
+      return 0;
+
+   offset     = bs->nbits;
+   bs->nbits += nbits;
+   BitStreamPutBits(bs, value, offset, nbits, order);
+   cleartail(bs);
+
+   return nbits;
+}
+
+/**
+ * @ingroup BitStream
+ * @fn uint64_t BitStreamAppendBytes(BitStream *bs, const uint8_t *buf,
+ * 	size_t n)
+ *
+ * @brief Appends n bytes to the end of bs, which need not end on a byte
+ * 	boundary, growing it as needed
+ *
+ * @param [in,out] *bs\n
+ * 	bit stream to append to
+ * @param [in] *buf\n
+ * 	bytes to append, must not point into bs
+ * @param [in] n\n
+ * 	number of bytes
+ * @returns number of bits appended, 0 on error
+ */
+uint64_t BitStreamAppendBytes(BitStream *bs, const uint8_t *buf, size_t n) {
+   uint64_t offset;
+
+   if (bs == NULL || buf == NULL || n == 0 || 
+       n > BITSTREAM_MAX_BITS / BITS_PER_BYTE ||
+       reserve(bs, bs->nbits + (uint64_t)n * BITS_PER_BYTE))
+      return 0;
+
+   offset     = bs->nbits;
+   bs->nbits += (uint64_t)n * BITS_PER_BYTE;
+   bitcopy(bs->array, offset, buf, 0, (uint64_t)n * BITS_PER_BYTE);
+   cleartail(bs);
+
+   return (uint64_t)n * BITS_PER_BYTE;
+}
+
+/**
+ * @ingroup BitStream
+ * @fn uint64_t BitStreamAppendStream(BitStream *bs, BitStream *src)
+ *
+ * @brief Appends all bits of src to the end of bs, growing it as needed
+ *
+ * @param [in,out] *bs\n
+ * 	bit stream to append to
+ * @param [in] *src\n
+ * 	bit stream to append, may be bs itself
+ * @returns number of bits appended, 0 on error
+ */
+uint64_t BitStreamAppendStream(BitStream *bs, BitStream *src) {
+   uint64_t offset, nbits;
+
+   if (bs == NULL || src == NULL || src->nbits == 0 || 
+       src->nbits > BITSTREAM_MAX_BITS - bs->nbits ||
+       reserve(bs, bs->nbits + src->nbits))
+      return 0;
+
+   offset     = bs->nbits;
+   nbits      = src->nbits; /* src may be bs */
+   bs->nbits += nbits;
+   bitcopy(bs->array, offset, src->array, 0, nbits);
+   cleartail(bs);
+
+   return nbits;
+}
+
+/**
+ * @def POPCOUNT_CHUNK
+ * @brief bytes realigned at a time when counting bits at unaligned offsets
+ */
+#define POPCOUNT_CHUNK	4096
+
+/**
+ * @fn static uint64_t popcount_words(const uint8_t *a, const uint8_t *b,\n
+ * 	size_t n)
+ *
+ * @brief Number of bits set in a ^ b (in a when b is NULL) over n bytes, 8
+ * 	bytes at a time
+ *
+ * Always inlined so that the popcnt instruction is used when the caller is
+ * compiled for it
+ */
+static inline __attribute__((always_inline)) 
+uint64_t popcount_words(const uint8_t *a, const uint8_t *b, size_t n) {
+    uint64_t total = 0, x, y;
+    size_t   i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+       memcpy(&x, a + i, sizeof(x));
+       if (b) {
+          memcpy(&y, b + i, sizeof(y));
+          x ^= y;
+       }
+       total += __builtin_popcountll(x);
+    }
+    for (; i < n; i++)
+       total += __builtin_popcount(b ? a[i] ^ b[i] : a[i]);
+    return total;
+}
+
+#if defined(BITSTREAM_X86)
+/**
+ * @fn static uint64_t popcount_popcnt(const uint8_t *a, const uint8_t *b,\n
+ * 	size_t n)
+ *
+ * @brief popcount_words() on the popcnt instruction
+ */
+__attribute__((target("popcnt")))
+static uint64_t popcount_popcnt(const uint8_t *a, const uint8_t *b, size_t n) {
+    return popcount_words(a, b, n);
+}
+
+/**
+ * @fn static __m256i popcount256(__m256i v)
+ *
+ * @brief Bits set in each 64 bit lane of v, by nibble lookups with pshufb
+ */
+__attribute__((target("avx2")))
+static inline __m256i popcount256(__m256i v) {
+    const __m256i lookup = _mm256_setr_epi8(
+		    0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+		    0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low = _mm256_set1_epi8(0x0F);
+    __m256i lo, hi;
+
+    lo = _mm256_shuffle_epi8(lookup, _mm256_and_si256(v, low));
+    hi = _mm256_shuffle_epi8(lookup, 
+		    _mm256_and_si256(_mm256_srli_epi16(v, 4), low));
+    return _mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256());
+}
+
+/**
+ * @def CSA256
+ * @brief carry save adder: h:l = a + b + c, bit by bit
+ */
+#define CSA256(h, l, a, b, c)	do {					\
+	__m256i u_ = _mm256_xor_si256((a), (b));			\
+	(h) = _mm256_or_si256(_mm256_and_si256((a), (b)),		\
+			_mm256_and_si256(u_, (c)));			\
+	(l) = _mm256_xor_si256(u_, (c));				\
+} while (0)
+
+/**
+ * @fn static size_t popcount_avx2(const uint8_t *a, const uint8_t *b,\n
+ * 	size_t n, uint64_t *count)
+ *
+ * @brief Harley-Seal population count of a ^ b (a when b is NULL), 512
+ * 	bytes per iteration
+ *
+ * Sixteen vectors are reduced by a tree of carry save adders into ones,
+ * twos, fours, eights and sixteens, and only the sixteens go through the
+ * (comparatively slow) pshufb count on every iteration
+ *
+ * @returns number of bytes processed, a multiple of 512
+ */
+__attribute__((target("avx2")))
+static size_t popcount_avx2(const uint8_t *a, const uint8_t *b, size_t n,
+		uint64_t *count) {
+    __m256i total = _mm256_setzero_si256();
+    __m256i ones = total, twos = total, fours = total, eights = total;
+    __m256i sixteens, twosA, twosB, foursA, foursB, eightsA, eightsB;
+    __m256i d[16];
+    size_t  i;
+    int     k;
+
+    for (i = 0; i + 512 <= n; i += 512) {
+       for (k = 0; k < 16; k++) {
+          d[k] = _mm256_loadu_si256((const __m256i *)(a + i + 32 * k));
+          if (b)
+             d[k] = _mm256_xor_si256(d[k], 
+			     _mm256_loadu_si256((const __m256i *)(b + i + 32 * k)));
+       }
+
+       CSA256(twosA, ones, ones, d[0], d[1]);
+       CSA256(twosB, ones, ones, d[2], d[3]);
+       CSA256(foursA, twos, twos, twosA, twosB);
+       CSA256(twosA, ones, ones, d[4], d[5]);
+       CSA256(twosB, ones, ones, d[6], d[7]);
+       CSA256(foursB, twos, twos, twosA, twosB);
+       CSA256(eightsA, fours, fours, foursA, foursB);
+       CSA256(twosA, ones, ones, d[8], d[9]);
+       CSA256(twosB, ones, ones, d[10], d[11]);
+       CSA256(foursA, twos, twos, twosA, twosB);
+       CSA256(twosA, ones, ones, d[12], d[13]);
+       CSA256(twosB, ones, ones, d[14], d[15]);
+       CSA256(foursB, twos, twos, twosA, twosB);
+       CSA256(eightsB, fours, fours, foursA, foursB);
+       CSA256(sixteens, eights, eights, eightsA, eightsB);
+
+       total = _mm256_add_epi64(total, popcount256(sixteens));
+    }
+
+    total = _mm256_slli_epi64(total, 4);
+    total = _mm256_add_epi64(total, 
+		    _mm256_slli_epi64(popcount256(eights), 3));
+    total = _mm256_add_epi64(total, _mm256_slli_epi64(popcount256(fours), 2));
+    total = _mm256_add_epi64(total, _mm256_slli_epi64(popcount256(twos), 1));
+    total = _mm256_add_epi64(total, popcount256(ones));
+
+    *count += (uint64_t)_mm256_extract_epi64(total, 0) + 
+	    (uint64_t)_mm256_extract_epi64(total, 1) +
+	    (uint64_t)_mm256_extract_epi64(total, 2) + 
+	    (uint64_t)_mm256_extract_epi64(total, 3);
+    return i;
+}
+
+/**
+ * @fn static size_t popcount_avx512(const uint8_t *a, const uint8_t *b,\n
+ * 	size_t n, uint64_t *count)
+ *
+ * @brief VPOPCNTDQ population count of a ^ b (a when b is NULL), 64 bytes
+ * 	per iteration with four independent accumulators
+ *
+ * @returns number of bytes processed, a multiple of 64
+ */
+__attribute__((target("avx512f,avx512vpopcntdq")))
+static size_t popcount_avx512(const uint8_t *a, const uint8_t *b, size_t n,
+		uint64_t *count) {
+    __m512i acc[4], v;
+    size_t  i;
+    int     k;
+
+    for (k = 0; k < 4; k++)
+       acc[k] = _mm512_setzero_si512();
+
+    for (i = 0; i + 256 <= n; i += 256) {
+       for (k = 0; k < 4; k++) {
+          v = _mm512_loadu_si512(a + i + 64 * k);
+          if (b)
+             v = _mm512_xor_si512(v, _mm512_loadu_si512(b + i + 64 * k));
+          acc[k] = _mm512_add_epi64(acc[k], _mm512_popcnt_epi64(v));
+       }
+    }
+    for (; i + 64 <= n; i += 64) {
+       v = _mm512_loadu_si512(a + i);
+       if (b)
+          v = _mm512_xor_si512(v, _mm512_loadu_si512(b + i));
+       acc[0] = _mm512_add_epi64(acc[0], _mm512_popcnt_epi64(v));
+    }
+
+    acc[0] = _mm512_add_epi64(_mm512_add_epi64(acc[0], acc[1]),
+		    _mm512_add_epi64(acc[2], acc[3]));
+    *count += (uint64_t)_mm512_reduce_add_epi64(acc[0]);
+    return i;
+}
+#endif /* BITSTREAM_X86 */
+
+/**
+ * @fn static uint64_t popcount_bytes(const uint8_t *a, const uint8_t *b,\n
+ * 	size_t n)
+ *
+ * @brief Number of bits set in a ^ b over n bytes, or in a when b is NULL
+ *
+ * Uses the widest kernel the cpu supports, the remainder goes through 
+ * popcnt 8 bytes at a time
+ */
+static uint64_t popcount_bytes(const uint8_t *a, const uint8_t *b, size_t n) {
+    uint64_t total = 0;
+    size_t   i = 0;
+#if defined(BITSTREAM_X86)
+    uint32_t cpu = cpu_features();
+
+    if (cpu & CPU_AVX512POPCNT)
+       i = popcount_avx512(a, b, n, &total);
+    else if (cpu & CPU_AVX2)
+       i = popcount_avx2(a, b, n, &total);
+
+    if (cpu & CPU_POPCNT)
+       return total + popcount_popcnt(a + i, b ? b + i : NULL, n - i);
+#endif
+    return total + popcount_words(a + i, b ? b + i : NULL, n - i);
+}
+
+/**
+ * @fn static uint64_t popcount_bits(const uint8_t *a, uint64_t aoff,\n
+ * 	const uint8_t *b, uint64_t boff, uint64_t nbits)
+ *
+ * @brief Number of bits set in nbits bits of a ^ b starting at bit offsets
+ * 	aoff and boff, or in a when b is NULL
+ *
+ * Byte aligned ranges are counted in place, others are realigned a chunk
+ * at a time with bitcopy
+ */
+static uint64_t popcount_bits(const uint8_t *a, uint64_t aoff, 
+		const uint8_t *b, uint64_t boff, uint64_t nbits) {
+    uint8_t     ta[POPCOUNT_CHUNK], tb[POPCOUNT_CHUNK];
+    const uint8_t *pa, *pb;
+    uint64_t    total = 0;
+    size_t      n;
+    int         aligned = aoff % BITS_PER_BYTE == 0 && 
+	    (b == NULL || boff % BITS_PER_BYTE == 0);
+    uint8_t     x;
+
+    while (nbits >= BITS_PER_BYTE) {
+       n  = nbits / BITS_PER_BYTE;
+       pa = a + aoff / BITS_PER_BYTE;
+       pb = b ? b + boff / BITS_PER_BYTE : NULL;
+       if (!aligned) {
+          n = MIN(n, POPCOUNT_CHUNK);
+          bitcopy(ta, 0, a, aoff, (uint64_t)n * BITS_PER_BYTE);
+          pa = ta;
+          if (b) {
+             bitcopy(tb, 0, b, boff, (uint64_t)n * BITS_PER_BYTE);
+             pb = tb;
+          }
+       }
+       total += popcount_bytes(pa, pb, n);
+       aoff  += (uint64_t)n * BITS_PER_BYTE;
+       boff  += (uint64_t)n * BITS_PER_BYTE;
+       nbits -= (uint64_t)n * BITS_PER_BYTE;
+    }
+
+    if (nbits) {
+       x = bitfetch8(a, aoff, nbits);
+       if (b)
+          x ^= bitfetch8(b, boff, nbits);
+       total += __builtin_popcount(x);
+    }
+    return total;
+}
+
+/**
+ * @ingroup BitStream
+ * @fn uint64_t BitStreamPopcount(BitStream *bs)
+ *
+ * @brief Counts the bits set in bitstream bs
+ *
+ * @param [in] *bs\n
+ * 	bit stream to count
+ * @returns number of one bits, 0 for an empty or NULL stream
+ */
+uint64_t BitStreamPopcount(BitStream *bs) {
+   return BitStreamPopcountRange(bs, 0, bs ? bs->nbits : 0);
+}
+
+/**
+ * @ingroup BitStream
+ * @fn uint64_t BitStreamPopcountRange(BitStream *bs, uint64_t offset,\n
+ * 	uint64_t nbits)
+ *
+ * @brief Counts the bits set in bits [offset, offset + nbits) of bs
+ *
+ * @param [in] *bs\n
+ * 	bit stream to count
+ * @param [in] offset\n
+ * 	first bit of the range
+ * @param [in] nbits\n
+ * 	length of the range, clipped to the end of bs
+ * @returns number of one bits in the range
+ */
+uint64_t BitStreamPopcountRange(BitStream *bs, uint64_t offset, 
+		uint64_t nbits) {
+   if (bs == NULL || offset >= bs->nbits)
+      return 0;
+
+   nbits = MIN(nbits, bs->nbits - offset);
+   return popcount_bits(bs->array, offset, NULL, 0, nbits);
+}
+
+/**
+ * @ingroup BitStream
+ * @fn uint64_t BitStreamHammingDistance(BitStream *a, BitStream *b)
+ *
+ * @brief Number of bit positions in which a and b differ
+ *
+ * Streams of different sizes are compared over the shorter one
+ *
+ * @param [in] *a\n
+ * 	bit stream a
+ * @param [in] *b\n
+ * 	bit stream b
+ * @returns the Hamming distance, 0 if either stream is NULL
+ */
+uint64_t BitStreamHammingDistance(BitStream *a, BitStream *b) {
+   if (a == NULL || b == NULL)
+      return 0;
+
+   return BitStreamHammingDistanceRange(a, 0, b, 0, MIN(a->nbits, b->nbits));
+}
+
+/**
+ * @ingroup BitStream
+ * @fn uint64_t BitStreamHammingDistanceRange(BitStream *a, uint64_t aOffset,\n
+ * 	BitStream *b, uint64_t bOffset, uint64_t nbits)
+ *
+ * @brief Number of differing bits between nbits bits of a starting at
+ * 	aOffset and of b starting at bOffset, such as two key size blocks 
+ * 	of one cipher text
+ *
+ * @param [in] *a\n
+ * 	bit stream a
+ * @param [in] aOffset\n
+ * 	first bit of the range in a
+ * @param [in] *b\n
+ * 	bit stream b, may be a itself
+ * @param [in] bOffset\n
+ * 	first bit of the range in b
+ * @param [in] nbits\n
+ * 	length of the ranges, clipped to the end of either stream
+ * @returns the Hamming distance of the ranges
+ */
+uint64_t BitStreamHammingDistanceRange(BitStream *a, uint64_t aOffset,
+		BitStream *b, uint64_t bOffset, uint64_t nbits) {
+   if (a == NULL || b == NULL || aOffset >= a->nbits || bOffset >= b->nbits)
+      return 0;
+
+   nbits = MIN(nbits, MIN(a->nbits - aOffset, b->nbits - bOffset));
+   return popcount_bits(a->array, aOffset, b->array, bOffset, nbits);
+}
+
+/**
+ * @ingroup BitStream
+ * @fn int BitStreamRankXorKeySizes(BitStream *bs, uint32_t minsize,\n
+ * 	uint32_t maxsize, XorKeySize *best, int n)
+ *
+ * @brief Ranks the likely key sizes of repeating key XOR cipher text bs
+ *
+ * For each key size the Hamming distance between consecutive key size
+ * blocks is averaged over up to XOR_KEYSIZE_PAIRS pairs and normalised to
+ * bits per byte. Blocks encrypted with the same key bytes differ only as 
+ * much as the plain text does, which for text is well below the 4 bits per
+ * byte of random data, so the true key size (and its multiples) come first
+ *
+ * @param [in] *bs\n
+ * 	cipher text, only whole bytes are used
+ * @param [in] minsize\n
+ * 	smallest key size in bytes to guess, at least 1
+ * @param [in] maxsize\n
+ * 	largest key size in bytes to guess, sizes without two whole blocks in
+ * 	bs are skipped
+ * @param [out] *best\n
+ * 	array of at least n entries, filled with the smallest distance first
+ * @param [in] n\n
+ * 	number of key sizes wanted
+ * @returns number of entries filled, -1 on error
+ */
+int BitStreamRankXorKeySizes(BitStream *bs, uint32_t minsize, 
+		uint32_t maxsize, XorKeySize *best, int n) {
+   size_t   nbytes, pairs, i;
+   uint64_t k, diff;
+   float    distance;
+   int      filled = 0, j;
+
+   if (bs == NULL || best == NULL || n < 0)
+      return (-1);
+
+   nbytes = bs->nbits / BITS_PER_BYTE;
+   for (k = minsize ? minsize : 1; k <= maxsize && 2 * k <= nbytes; k++) {
+      pairs = MIN(nbytes / k - 1, XOR_KEYSIZE_PAIRS);
+      for (diff = 0, i = 0; i < pairs; i++)
+         diff += popcount_bytes(bs->array + i * k, bs->array + (i + 1) * k, k);
+      distance = (double)diff / (pairs * k);
+
+      /* insertion into the sorted best list, ties keep the smaller size */
+      if (n == 0 || (filled == n && distance >= best[n - 1].distance))
+         continue;
+      j = filled < n ? filled++ : n - 1;
+      for (; j > 0 && best[j - 1].distance > distance; j--)
+         best[j] = best[j - 1];
+      best[j].keysize  = k;
+      best[j].distance = distance;
+   }
+   return filled;
+}
+
+/**
+ * @fn static int solvecolumns(const uint8_t *buf, size_t n, size_t keysize,\n
+ * 	uint8_t *key, float *score)
+ *
+ * @brief Recovers a keysize byte repeating XOR key, column by column
+ *
+ * Column c holds the bytes at positions c, c + keysize, ... which are all
+ * XORed with key byte c, so each is a single byte XOR problem solved from 
+ * its histogram. One sequential pass over buf fills the histograms of all
+ * columns at once, so no transposed copy is ever made
+ *
+ * @param [in] buf\n
+ * 	cipher text
+ * @param [in] n\n
+ * 	number of bytes, at least keysize
+ * @param [in] keysize\n
+ * 	key size in bytes
+ * @param [out] key\n
+ * 	keysize bytes receiving the best key byte of every column
+ * @param [out] score\n
+ * 	EnglishScore of the whole plain text under that key
+ * @returns 0 on success, -1 on allocation failure
+ */
+static int solvecolumns(const uint8_t *buf, size_t n, size_t keysize, 
+		uint8_t *key, float *score) {
+    uint32_t *hist;
+    double   *sum, total = 0;
+    float    part[256];
+    size_t   start, len, r, c;
+    int      b;
+
+    hist = malloc(keysize * 256 * sizeof(uint32_t));
+    sum  = calloc(keysize * 256, sizeof(double));
+    if (hist == NULL || sum == NULL) {
+       free(hist);
+       free(sum);
+       return (-1);
+    }
+
+    /* chunks start on a row so byte i always falls in column i % keysize */
+    for (start = 0; start < n; start += len) {
+       len = MIN(n - start, HISTOGRAM_CHUNK / keysize * keysize);
+       memset(hist, 0, keysize * 256 * sizeof(uint32_t));
+       for (r = start; r + keysize <= start + len; r += keysize)
+          for (c = 0; c < keysize; c++)
+             hist[c * 256 + buf[r + c]] ++;
+       for (c = 0; r + c < start + len; c++)
+          hist[c * 256 + buf[r + c]] ++;
+
+       for (c = 0; c < keysize; c++) {
+          xorscores(hist + c * 256, part);
+          for (b = 0; b < 256; b++)
+             sum[c * 256 + b] += part[b];
+       }
+    }
+
+    for (c = 0; c < keysize; c++) {
+       key[c] = 0;
+       for (b = 1; b < 256; b++)
+          if (sum[c * 256 + b] > sum[c * 256 + key[c]])
+             key[c] = b;
+       total += sum[c * 256 + key[c]];
+    }
+    *score = total / n;
+
+    free(hist);
+    free(sum);
+    return 0;
+}
+
+/**
+ * @ingroup BitStream
+ * @fn uint64_t BitStreamBreakRepeatingXor(BitStream *bs, uint32_t maxsize,\n
+ * 	BitStream *key)
+ *
+ * @brief Recovers the key of English text encrypted with repeating key XOR
+ *
+ * The XOR_KEYSIZE_CANDIDATES best key sizes of BitStreamRankXorKeySizes 
+ * are each solved column by column, the key whose plain text scores best
+ * wins. A key made of a shorter key repeated is cut to that shorter key
+ *
+ * @param [in] *bs\n
+ * 	cipher text, only whole bytes are used
+ * @param [in] maxsize\n
+ * 	largest key size in bytes to consider
+ * @param [out] *key\n
+ * 	bit stream receiving the key, resized to its length
+ * @returns key length in bits, 0 if no key could be recovered
+ */
+uint64_t BitStreamBreakRepeatingXor(BitStream *bs, uint32_t maxsize, 
+		BitStream *key) {
+   XorKeySize cand[XOR_KEYSIZE_CANDIDATES];
+   uint8_t    *guess = NULL, *win = NULL;
+   float      score, bestscore = -FLT_MAX;
+   size_t     nbytes, winsize = 0, p;
+   int        ncand, i;
+
+   if (bs == NULL || key == NULL)
+      return 0;
+
+   nbytes = bs->nbits / BITS_PER_BYTE;
+   ncand  = BitStreamRankXorKeySizes(bs, 1, maxsize, cand, 
+		   XOR_KEYSIZE_CANDIDATES);
+   if (ncand <= 0)
+      return 0;
+
+   for (i = 0; i < ncand; i++) {
+      guess = malloc(cand[i].keysize);
+      if (guess == NULL || 
+          solvecolumns(bs->array, nbytes, cand[i].keysize, guess, &score)) {
+         free(guess);
+         free(win);
+         return 0;
+      }
+      if (score > bestscore) {
+         free(win);
+         win       = guess;
+         winsize   = cand[i].keysize;
+         bestscore = score;
+      } else {
+         free(guess);
+      }
+   }
+
+   /* smallest period of the winning key */
+   for (p = 1; p < winsize; p++)
+      if (winsize % p == 0 && memcmp(win, win + p, winsize - p) == 0)
+         break;
+
+   if (BitStreamRealloc(key, NULL, (uint64_t)p * BITS_PER_BYTE)) {
+      free(win);
+      return 0;
    }
+   memcpy(key->array, win, p);
+   free(win);
+
+   return (uint64_t)p * BITS_PER_BYTE;
 }
 
 /**
- * @ingroup BitStream
- * @fn void BitSreamShow(BitStream* bs, const char* fmt)
- * @brief Show contents of bit stream as hex array in "pretty" format 
- * 	prints both ascii and hex values helpful in debugging
- *
- * @param [in]	bs\n
- *  	pointer to bitstream to show
- * @returns void
+ * @def TRANSPOSE_TILE
+ * @brief side of the byte tiles BitStreamTranspose moves at a time
  */
-void BitStreamShow(BitStream* bs) {
-   uint16_t i = 0;
+#define TRANSPOSE_TILE	16
 
-   char repr[32] = {'\0'};
+#if defined(BITSTREAM_X86)
+/**
+ * @fn static void transpose16_sse2(const uint8_t *src, size_t stride,\n
+ * 	uint8_t *const dst[16])
+ *
+ * @brief Transposes the 16x16 byte tile at src (rows stride bytes apart),
+ * 	row j of the result goes to dst[j]
+ *
+ * Four rounds of interleaving row k with row k + 8 (unpacklo/hi) move each
+ * byte (i, j) to (j, i), one index bit per round
+ */
+__attribute__((target("sse2")))
+static void transpose16_sse2(const uint8_t *src, size_t stride, 
+		uint8_t *const dst[16]) {
+    __m128i a[16], b[16];
+    int     k, round;
 
-   if (bs != NULL && bs->array != NULL) {
-      printf("%03d\t", i);
-      for (i = 0; i < (bs->nbits + BITS_PER_BYTE - 1)/BITS_PER_BYTE; i++) {
+    for (k = 0; k < 16; k++)
+       a[k] = _mm_loadu_si128((const __m128i *)(src + k * stride));
 
-         if ((i != 0) && (i % 8 == 0))
-		 printf("  ");
-         if ((i != 0) && (i % 16 == 0)) 
-		 printf("%s\n%03d\t", repr, i);
+    for (round = 0; round < 4; round++) {
+       for (k = 0; k < 8; k++) {
+          b[2 * k]     = _mm_unpacklo_epi8(a[k], a[k + 8]);
+          b[2 * k + 1] = _mm_unpackhi_epi8(a[k], a[k + 8]);
+       }
+       memcpy(a, b, sizeof(a));
+    }
 
-         sprintf(repr + (i % 16),"%c", isprint(bs->array[i]) ? bs->array[i] : 
-			 '.');
-         printf("%02x", bs->array[i]);
-      }
-      /* Now print the remaining gap till the place holder for ascii
-       */
-      if (strlen(repr) < 16) {
-         while (i++ % 16) {
-	    printf("  ");
-            if ((i != 0) && (i % 8 == 0))
-	       printf("  ");
-         }
-      } else {
-	   printf("  ");
-      } /* if strlen(repr) < 16 */
-      printf("%s\n", repr); /* push out the left over characters from loop */
-   } 
-   printf("\n");
+    for (k = 0; k < 16; k++)
+       _mm_storeu_si128((__m128i *)dst[k], a[k]);
 }
+#endif
 
 /**
- * @ingroup BitStream
- * @fn uint16_t BitStreamPutByte(BitStream* bs, uint8_t byte, uint16_t offset,\n 
- * 	uint16_t nbits) 
- *
- * @brief inserts maximum 1 byte of data in bit stream at offset (in bits) nbits
+ * @fn static void transposebytes(uint8_t *dst, const uint8_t *src, size_t n,\n
+ * 	size_t stride)
  *
- * If the number of bits inserted are less than BITS_PER_BYTE (8) then the bits
- * are shifted left so that they are aligned in network order, i.e, inserting 3 
- * bits (101b) will cause the bits to be inserted in the specified byte as follows
- * 	- 101xxxxxb
- * where 'x' indicates the existing bits in stream
+ * @brief Writes the n bytes of src, read as rows of stride bytes, column 
+ * 	after column into dst
  *
- * @param [in] bs\n
- * 	Bit stream in which the bits are to be inserted
- * @param [in] byte\n
- * 	Bits to be inserted in bit stream (maximum 8)
- * @param [in] offset\n
- * 	offset in bits at which the above byte is to be inserted
- * @param [in] nbits\n
- * 	number of bits to insert, by default is should be 8, else the shift as
- * 	explained above applies
- * @returns Number of bits inserted. Insertion fails while inserting bits 
- * 	beyond the size of bit stream
+ * The matrix is walked in TRANSPOSE_TILE square tiles so that both the 
+ * rows read and the columns written stay in cache, full tiles go through
+ * the SIMD kernel
  */
-uint16_t BitStreamPutByte(BitStream* bs, uint8_t byte, uint16_t offset, 
-	uint16_t nbits) {
+static void transposebytes(uint8_t *dst, const uint8_t *src, size_t n, 
+		size_t stride) {
+    size_t  rows = n / stride, rem = n % stride;
+    size_t  r, c, i, j;
+    uint8_t *col[TRANSPOSE_TILE];
 
-   uint16_t curBits;
-   uint8_t mask;
-   uint16_t bitsCopied = 0;
+    /* column c starts after c full columns and the extra bytes before it */
+#define COLUMN(c)	((c) * rows + MIN((c), rem))
 
-   DECL_BYTE_OFFSET(i);
-   DECL_BITS_OFFSET(j);
+    for (r = 0; r < rows; r += TRANSPOSE_TILE) {
+       for (c = 0; c < stride; c += TRANSPOSE_TILE) {
+#if defined(BITSTREAM_X86)
+          if (r + TRANSPOSE_TILE <= rows && c + TRANSPOSE_TILE <= stride) {
+             for (j = 0; j < TRANSPOSE_TILE; j++)
+                col[j] = dst + COLUMN(c + j) + r;
+             transpose16_sse2(src + r * stride + c, stride, col);
+             continue;
+          }
+#endif
+          for (i = r; i < MIN(r + TRANSPOSE_TILE, rows); i++)
+             for (j = c; j < MIN(c + TRANSPOSE_TILE, stride); j++)
+                dst[COLUMN(j) + i] = src[i * stride + j];
+       }
+    }
 
-   if (offset > bs->nbits)
-	   return 0;
+    for (j = 0; j < rem; j++)
+       dst[COLUMN(j) + rows] = src[rows * stride + j];
+#undef COLUMN
+}
 
-   nbits = MIN(nbits, (bs->nbits - offset));
+/**
+ * @ingroup BitStream
+ * @fn BitStream* BitStreamTranspose(BitStream *bs, uint64_t stride)
+ *
+ * @brief Reads the bytes of bs as a matrix of rows stride bytes long and 
+ * 	returns it column after column
+ *
+ * Column c holds bytes c, c + stride, c + 2 * stride ... of bs, such as 
+ * every byte XORed with key byte c of a stride byte repeating key. With n
+ * bytes in bs it starts at byte c * (n / stride) + MIN(c, n % stride) of 
+ * the result and is n / stride + (c < n % stride) bytes long; 
+ * BitStreamSlice returns it as a stream of its own without copying. When
+ * n is a multiple of stride, transposing the result with stride 
+ * n / stride gives back bs
+ *
+ * @param [in] *bs\n
+ * 	bit stream to transpose, a trailing partial byte is left out
+ * @param [in] stride\n
+ * 	number of columns (bytes per row), at least 1
+ * @returns pointer to a new bit stream holding the columns, NULL on error
+ */
+BitStream* BitStreamTranspose(BitStream *bs, uint64_t stride) {
+   BitStream *out;
+   size_t    nbytes;
 
-   if (nbits < 8) byte = byte << (BITS_PER_BYTE - nbits);
+   if (bs == NULL || stride == 0)
+      return NULL;
 
-   curBits = MIN((BITS_PER_BYTE - j), nbits);
+   nbytes = bs->nbits / BITS_PER_BYTE;
+   out    = BitStreamCreate((uint64_t)nbytes * BITS_PER_BYTE);
+   if (out != NULL && nbytes)
+      transposebytes(out->array, bs->array, nbytes, 
+		      MIN(stride, (uint64_t)nbytes));
+   return out;
+}
 
-   mask = (0xFF >> j) & (0xFF << (BITS_PER_BYTE - (j + curBits)));
+/**
+ * @fn static uint64_t transpose8(uint64_t x)
+ *
+ * @brief Transposes the 8x8 bit matrix x, row i in byte 7 - i and column j
+ * 	in bit 7 - j of every byte (a big endian load of 8 stream bytes)
+ *
+ * Three delta swaps exchange the off diagonal 1x1, 2x2 and 4x4 blocks
+ */
+static inline uint64_t transpose8(uint64_t x) {
+    uint64_t t;
 
-   bs->array[i] = (bs->array[i] & ~mask) | ((byte >> j) & mask);
+    t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAULL;
+    x = x ^ t ^ (t << 7);
+    t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCULL;
+    x = x ^ t ^ (t << 14);
+    t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ULL;
+    x = x ^ t ^ (t << 28);
+    return x;
+}
 
-   bitsCopied += curBits;
+#if defined(BITSTREAM_X86)
+/**
+ * @fn static size_t transpose8_gfni(uint8_t *p, size_t nblocks)
+ *
+ * @brief Transposes 8x8 bit blocks in place, four per instruction
+ *
+ * gf2p8affine multiplies every byte of its first operand by the 8x8 bit
+ * matrix in the second; the bytes 0x80, 0x40 ... 0x01 of the constant pick
+ * the columns of the block one after the other, which is the transpose
+ *
+ * @returns number of blocks processed, a multiple of 4
+ */
+__attribute__((target("avx2,gfni")))
+static size_t transpose8_gfni(uint8_t *p, size_t nblocks) {
+    const __m256i pick = _mm256_set1_epi64x(0x0102040810204080LL);
+    size_t i;
 
-   byte = byte << curBits;
+    for (i = 0; i + 4 <= nblocks; i += 4)
+       _mm256_storeu_si256((__m256i *)(p + 8 * i), 
+		       _mm256_gf2p8affine_epi64_epi8(pick, 
+			       _mm256_loadu_si256((__m256i *)(p + 8 * i)), 0));
+    return i;
+}
+#endif
 
-   if (curBits < nbits) {
-      curBits = nbits - curBits;
+/**
+ * @fn static void transpose8_blocks(uint8_t *p, size_t nblocks)
+ *
+ * @brief Transposes nblocks consecutive 8 byte bit matrices in place
+ */
+static void transpose8_blocks(uint8_t *p, size_t nblocks) {
+    size_t i = 0;
 
-      mask = 0xFF << (BITS_PER_BYTE - curBits);
+#if defined(BITSTREAM_X86)
+    if (cpu_features() & CPU_GFNI)
+       i = transpose8_gfni(p, nblocks);
+#endif
+    for (; i < nblocks; i++)
+       store64be(p + 8 * i, transpose8(load64be(p + 8 * i)));
+}
 
-      bs->array[i + 1] = (bs->array[i + 1] & ~mask) | (byte & mask);
+/**
+ * @fn static void transpose64(uint64_t a[64])
+ *
+ * @brief Transposes the 64x64 bit matrix with row i in a[i] and column j in
+ * 	bit 63 - j
+ *
+ * Six rounds of delta swaps exchange the off diagonal 32x32, 16x16 ... 1x1
+ * blocks, each round touching every row once
+ */
+static void transpose64(uint64_t a[64]) {
+    uint64_t m = 0x00000000FFFFFFFFULL, t;
+    uint32_t j, k;
 
-      bitsCopied += curBits;
-   }
-   return bitsCopied;
+    for (j = 32; j != 0; j >>= 1, m ^= m << j) {
+       for (k = 0; k < 64; k = ((k | j) + 1) & ~j) {
+          t = (a[k] ^ (a[k | j] >> j)) & m;
+          a[k]     ^= t;
+          a[k | j] ^= t << j;
+       }
+    }
 }
 
 /**
  * @ingroup BitStream
- * @fn uint16_t BitStreamGetByte(BitStream* bs, uint8_t *byte, uint16_t offset,\n 
- * 	uint16_t nbits) 
+ * @fn uint64_t BitStreamTransposeBits8(BitStream *bs)
  *
- * @brief fetches maximum 1 byte of data in bit stream at offset (in bits) nbits
+ * @brief Transposes every 8 byte block of bs in place as an 8x8 bit matrix
  *
- * If the number of bits requested are less than BITS_PER_BYTE (8) then the bits
- * are shifted right so that they are aligned in host order, i.e, requesting 3 
- * bits at offset 0, will fetch the bits as 00000xxx where xxx are the fetched 
- * bits
+ * Byte i of a block is row i, bit j of the row (in stream order, MSB 
+ * first) is column j. Afterwards byte j holds bit j of the 8 bytes
  *
- * @param [in] bs\n
- * 	Bit stream in which the bits are to be inserted
- * @param [out] *byte\n
- * 	Bits fetched from the stream (maxium 8)
- * @param [in] offset\n
- * 	offset in bits from which the above byte is to be fetched
- * @param [in] nbits\n
- * 	number of bits to insert, by default is should be 8, else the shift as
- * 	explained above applies
- * @returns Number of bits fetched. Retrieval fails while fetching bits 
- * 	beyond the size of bit stream
+ * @param [in,out] *bs\n
+ * 	bit stream, a trailing partial block is left as is
+ * @returns number of bits transposed
  */
-uint16_t BitStreamGetByte(BitStream *bs, uint8_t *byte, uint16_t offset, 
-		uint16_t nbits) {
-
-   uint16_t curBits;
-   uint8_t mask;
-   uint16_t bitsCopied = 0;
+uint64_t BitStreamTransposeBits8(BitStream *bs) {
+   size_t nblocks;
 
-   DECL_BYTE_OFFSET(i);
-   DECL_BITS_OFFSET(j);
-
-   if (offset > bs->nbits)
-	   return (0);
+   if (bs == NULL)
+      return 0;
 
-   nbits = MIN(nbits, (bs->nbits - offset));
+   nblocks = bs->nbits / 64;
+   transpose8_blocks(bs->array, nblocks);
+   return (uint64_t)nblocks * 64;
+}
 
-   curBits = MIN((BITS_PER_BYTE - j), nbits);
+/**
+ * @ingroup BitStream
+ * @fn uint64_t BitStreamTransposeBits64(BitStream *bs)
+ *
+ * @brief Transposes every 512 byte block of bs in place as a 64x64 bit 
+ * 	matrix, row i being bytes 8 * i to 8 * i + 7
+ *
+ * @param [in,out] *bs\n
+ * 	bit stream, a trailing partial block is left as is
+ * @returns number of bits transposed
+ */
+uint64_t BitStreamTransposeBits64(BitStream *bs) {
+   uint64_t a[64];
+   size_t   nblocks, b;
+   int      i;
 
-   mask = (0xFF >> j) & (0xFF << (BITS_PER_BYTE - (j + curBits)));
+   if (bs == NULL)
+      return 0;
 
-   *byte = (bs->array[i] & mask) << j;
+   nblocks = bs->nbits / (64 * 64);
+   for (b = 0; b < nblocks; b++) {
+      for (i = 0; i < 64; i++)
+         a[i] = load64be(bs->array + 512 * b + 8 * i);
+      transpose64(a);
+      for (i = 0; i < 64; i++)
+         store64be(bs->array + 512 * b + 8 * i, a[i]);
+   }
+   return (uint64_t)nblocks * 64 * 64;
+}
 
-   bitsCopied += curBits;
+/**
+ * @fn static uint64_t bitplanes(BitStream *bs, int inverse)
+ *
+ * @brief Converts every 64 byte block of bs between bytes and bit planes
+ *
+ * Going to planes, each 8 byte group is bit transposed and the 8x8 matrix
+ * of resulting bytes is transposed so plane p gathers row p of all groups.
+ * Coming back does the same steps in reverse order
+ */
+static uint64_t bitplanes(BitStream *bs, int inverse) {
+   uint8_t tmp[64];
+   uint8_t *p;
+   size_t  nblocks, b;
 
-   if (curBits < nbits) {
-      curBits = nbits - curBits;
+   if (bs == NULL)
+      return 0;
 
-      mask = 0xFF << (BITS_PER_BYTE - curBits);
+   nblocks = bs->nbits / 512;
+   for (b = 0; b < nblocks; b++) {
+      p = bs->array + 64 * b;
+      if (!inverse)
+         transpose8_blocks(p, 8);
+      transposebytes(tmp, p, 64, 8);
+      memcpy(p, tmp, sizeof(tmp));
+      if (inverse)
+         transpose8_blocks(p, 8);
+   }
+   return (uint64_t)nblocks * 512;
+}
 
-      *byte |= (bs->array[i + 1] & mask) >> (BITS_PER_BYTE - j);
+/**
+ * @ingroup BitStream
+ * @fn uint64_t BitStreamToBitPlanes(BitStream *bs)
+ *
+ * @brief Bit slices every 64 byte block of bs in place into 8 bit planes
+ *
+ * Plane p, bytes 8 * p to 8 * p + 7 of the block, holds bit p (counted 
+ * from the MSB) of each of the 64 bytes in order, so a boolean function of
+ * the bits of a byte can be evaluated for all 64 bytes with word wide 
+ * operations on the planes
+ *
+ * @param [in,out] *bs\n
+ * 	bit stream, a trailing partial block is left as is
+ * @returns number of bits converted
+ */
+uint64_t BitStreamToBitPlanes(BitStream *bs) {
+   return bitplanes(bs, 0);
+}
 
-      bitsCopied += curBits;
-   }
+/**
+ * @ingroup BitStream
+ * @fn uint64_t BitStreamFromBitPlanes(BitStream *bs)
+ *
+ * @brief Reverses BitStreamToBitPlanes, in place
+ *
+ * @param [in,out] *bs\n
+ * 	bit stream of 64 byte blocks of 8 bit planes
+ * @returns number of bits converted
+ */
+uint64_t BitStreamFromBitPlanes(BitStream *bs) {
+   return bitplanes(bs, 1);
+}
 
-   if (nbits < 8) *byte = *byte >> (BITS_PER_BYTE - nbits);
+/**
+ * @fn static void bitzero(uint8_t *dst, uint64_t offset, uint64_t nbits)
+ *
+ * @brief Clears nbits of dst from bit offset, bits around them are kept
+ */
+static void bitzero(uint8_t *dst, uint64_t offset, uint64_t nbits) {
+    uint32_t head = MIN((BITS_PER_BYTE - offset % BITS_PER_BYTE) % 
+		    BITS_PER_BYTE, nbits);
 
-   return bitsCopied;
+    if (head) {
+       bitstore8(dst, offset, 0, head);
+       offset += head;
+       nbits  -= head;
+    }
+    memset(dst + offset / BITS_PER_BYTE, 0, nbits / BITS_PER_BYTE);
+    if (nbits % BITS_PER_BYTE)
+       bitstore8(dst, offset + nbits / BITS_PER_BYTE * BITS_PER_BYTE, 0, 
+		       nbits % BITS_PER_BYTE);
 }
 
 /**
  * @ingroup BitStream
- * @fn uint16_t BitStreamCopy(BitStream* bs, uint8_t* inp, uint16_t nbits) 
+ * @fn BitStream* BitStreamShiftLeft(BitStream *bs, uint64_t k)
  *
- * @brief Copies the bytes from input buffer into bit stream
+ * @brief Returns bs shifted k bits towards its start, bit i of the result
+ * 	is bit i + k of bs and the last k bits are zero
  *
- * @param [in,out] bs\n
- * 	bit stream to fill data in
- * @param [in] *inp\n
- * 	pointer to the data to be copied
- * @param [in] nbits\n
- * 	size of input data in bits
- * @returns number of bits copied into bit stream
+ * The bits are moved a 64 bit word (or a 256 bit register) at a time, 
+ * each word taking the top bits of the next one, whatever the alignment 
+ * of k
+ *
+ * @param [in] *bs\n
+ * 	bit stream to shift
+ * @param [in] k\n
+ * 	number of bits to shift by, all bits are cleared when at least the 
+ * 	size of bs
+ * @returns pointer to a new bit stream of the size of bs, NULL on error
  */
-uint16_t BitStreamCopy(BitStream* bs, uint8_t* inp, uint16_t nbits) {
-   uint16_t bitsCopied = 0;
-   
-   while (bitsCopied < bs->nbits) {
-      bitsCopied += BitStreamPutByte(bs, *inp++, bitsCopied, BITS_PER_BYTE);
-   }
+BitStream* BitStreamShiftLeft(BitStream *bs, uint64_t k) {
+   BitStream *out;
 
-   return bitsCopied;
+   if (bs == NULL)
+      return NULL;
+
+   k   = MIN(k, bs->nbits);
+   out = BitStreamCreate(bs->nbits);
+   if (out != NULL)
+      bitcopy(out->array, 0, bs->array, k, bs->nbits - k);
+   return out;
 }
 
 /**
  * @ingroup BitStream
- * @fn uint16_t BitStreamFill(BitStream* bs, uint8_t* inp, uint16_t nbits) 
+ * @fn BitStream* BitStreamShiftRight(BitStream *bs, uint64_t k)
  *
- * @brief Fills the byte into bit stream
+ * @brief Returns bs shifted k bits towards its end, bit i + k of the result
+ * 	is bit i of bs and the first k bits are zero
  *
- * @param [in,out] bs\n
- * 	bit stream to fill data in
- * @param [in] byte\n
- * 	byte to be copied in the bitstream
- * @returns number of bits copied into bit stream
+ * @param [in] *bs\n
+ * 	bit stream to shift
+ * @param [in] k\n
+ * 	number of bits to shift by, all bits are cleared when at least the 
+ * 	size of bs
+ * @returns pointer to a new bit stream of the size of bs, NULL on error
  */
-uint16_t BitStreamFill(BitStream* bs, uint8_t byte) {
-   uint16_t bitsCopied = 0;
-   
-   while (bitsCopied < bs->nbits) {
-      bitsCopied += BitStreamPutByte(bs, byte, bitsCopied, BITS_PER_BYTE);
-   }
+BitStream* BitStreamShiftRight(BitStream *bs, uint64_t k) {
+   BitStream *out;
 
-   return bitsCopied;
+   if (bs == NULL)
+      return NULL;
+
+   k   = MIN(k, bs->nbits);
+   out = BitStreamCreate(bs->nbits);
+   if (out != NULL)
+      bitcopy(out->array, k, bs->array, 0, bs->nbits - k);
+   return out;
 }
+
 /**
  * @ingroup BitStream
- * @fn uint16_t BitStreamCopyHex(BitStream* bs, uint8_t* inp)
+ * @fn uint64_t BitStreamShiftLeftInPlace(BitStream *bs, uint64_t k)
  *
- * @brief fills the bytes from input HEX ascii buffer into bit stream
+ * @brief Shifts bs k bits towards its start in place, see 
+ * 	BitStreamShiftLeft()
  *
- * @param [in,out] bs\n
- * 	bit stream to fill data in
- * @param [in] *inp\n
- * 	pointer to the data to be copied, should be NULL terminated with valid
- * 	hex charcters, else assert(0)
- * @returns number of bits copied into bit stream
+ * Realigns a payload starting at bit k of a received buffer to bit 0 
+ * without any allocation
+ *
+ * @param [in,out] *bs\n
+ * 	bit stream to shift
+ * @param [in] k\n
+ * 	number of bits to shift by
+ * @returns number of bits in bs, 0 on error
  */
-uint16_t BitStreamCopyHex(BitStream* bs, const char* inp) {
-   
-   uint16_t size = (strlen(inp) + 1) >> 1;
+uint64_t BitStreamShiftLeftInPlace(BitStream *bs, uint64_t k) {
 
-   if (bs) {
-      BitStreamRealloc(bs, NULL, size * BITS_PER_BYTE);
+   if (bs == NULL || bs->nbits == 0)
+      return 0;
 
-      strtox(inp, bs->array, size);
-   }
-   return size * BITS_PER_BYTE;
+   k = MIN(k, bs->nbits);
+   bitcopy(bs->array, 0, bs->array, k, bs->nbits - k);
+   bitzero(bs->array, bs->nbits - k, k);
+   return bs->nbits;
 }
 
 /**
  * @ingroup BitStream
- * @fn uint16_t BitStreamCopyAscii(BitStream* bs, uint8_t* inp)
+ * @fn uint64_t BitStreamShiftRightInPlace(BitStream *bs, uint64_t k)
  *
- * @brief fills the bytes from input ascii buffer into bit stream
+ * @brief Shifts bs k bits towards its end in place, see 
+ * 	BitStreamShiftRight()
  *
- * @param [in,out] bs\n
- * 	bit stream to fill data in, should be NULL terminated
- * @param [in] *inp\n
- * 	pointer to the data to be copied
- * @returns number of bits copied into bit stream
+ * @param [in,out] *bs\n
+ * 	bit stream to shift
+ * @param [in] k\n
+ * 	number of bits to shift by
+ * @returns number of bits in bs, 0 on error
  */
-uint16_t BitStreamCopyAscii(BitStream* bs, const char* inp) {
-   
-   uint16_t size = strlen(inp);
-   uint16_t bitsCopied = 0;
+uint64_t BitStreamShiftRightInPlace(BitStream *bs, uint64_t k) {
 
-   if (bs) {
-      BitStreamRealloc(bs, NULL, size * BITS_PER_BYTE);
-      if (bs->array != NULL)
-          bitsCopied = BitStreamCopy(bs, inp, size);
-   }
-   return bitsCopied;
+   if (bs == NULL || bs->nbits == 0)
+      return 0;
+
+   k = MIN(k, bs->nbits);
+   bitcopyback(bs->array, k, bs->array, 0, bs->nbits - k);
+   bitzero(bs->array, 0, k);
+   return bs->nbits;
+}
+
+/**
+ * @fn static uint64_t rotation(int64_t k, uint64_t nbits)
+ *
+ * @brief Reduces a rotation by k bits (negative towards the end) to the 
+ * 	equivalent rotation towards the start, 0 to nbits - 1
+ */
+static inline uint64_t rotation(int64_t k, uint64_t nbits) {
+    uint64_t r = (k < 0 ? 0 - (uint64_t)k : (uint64_t)k) % nbits;
+
+    return (k < 0 && r) ? nbits - r : r;
 }
+
 /**
  * @ingroup BitStream
- * @fn BitStream* BitStreamHex2Base64(BitStream *bs) 
+ * @fn BitStream* BitStreamRotate(BitStream *bs, int64_t k)
  *
- * @brief converts input bitstream of HEX ascii characters into Base64 bitstream
+ * @brief Returns bs rotated by k bits, bit i of the result is bit 
+ * 	(i + k) mod n of bs for a stream of n bits
  *
  * @param [in] *bs\n
- * 	pointer to HEX ascii bit stream for conversion
- * @returns pointer to Base64 bit stream converted from input, NULL in case of
- * 	any error
+ * 	bit stream to rotate
+ * @param [in] k\n
+ * 	number of bits to rotate by, towards the start when positive and 
+ * 	towards the end when negative
+ * @returns pointer to a new bit stream of the size of bs, NULL on error
  */
-BitStream* BitStreamHex2Base64(BitStream *bs) {
-   BitStream* out    = NULL;
-   uint16_t   outset = 0;  /* portmanteau of out offset -:) */
-   uint16_t   offset = 0;
-   uint8_t    byte   = 0;
+BitStream* BitStreamRotate(BitStream *bs, int64_t k) {
+   BitStream *out;
+   uint64_t  r;
 
-   if (bs) {
-      out = BitStreamCreate((bs->nbits * 4)/3);
-      while (out != NULL && BitStreamGetByte(bs, &byte, offset, 6) > 0) {
-   	   switch (byte) {
-   	   case 0 ... 25:
-   		   byte = 'A' + (byte - 0U);
-   		   break;
-   	   case 26 ... 51:
-		   byte = 'a' + (byte - 26);
-   		   break;
-   	   case 52 ... 61:
-		   byte = '0' + (byte - 52);
-   		   break;
-   	   case 62: 
-		   byte = '+';
-   		   break;
-   	   case 63:
-		   byte = '/';
-   		   break;
-   	   default: 
-		   byte = '?';
-   	   }
-	   if (BitStreamPutByte(out, byte, outset, BITS_PER_BYTE) <= 0)
-		   break;
-	   outset += BITS_PER_BYTE;
-   	   offset += 6;
-      }
+   if (bs == NULL)
+      return NULL;
+
+   out = BitStreamCreate(bs->nbits);
+   if (out != NULL && bs->nbits) {
+      r = rotation(k, bs->nbits);
+      bitcopy(out->array, 0, bs->array, r, bs->nbits - r);
+      bitcopy(out->array, bs->nbits - r, bs->array, 0, r);
    }
    return out;
 }
 
+/**
+ * @def ROTATE_SCRATCH_BYTES
+ * @brief largest part BitStreamRotateInPlace sets aside on the stack, 
+ * 	longer ones go to the heap
+ */
+#define ROTATE_SCRATCH_BYTES	1024
+
 /**
  * @ingroup BitStream
- * @fn BitStream* BitStreamExclusiveOr(BitStream *bx, BitStream *by) 
- *
- * @brief Performs exclusive OR of bitstream bx against bitstream by and returns
- *	bitstream bz
+ * @fn uint64_t BitStreamRotateInPlace(BitStream *bs, int64_t k)
  *
- * If the size of bx is larger than size of by, by rolls over to continue xor
- * operation. The routine allocates a new object of type BitStream and returns
- * pointer to the same
+ * @brief Rotates bs by k bits in place, see BitStreamRotate()
  *
- * FIXME: the rollover works good only when the offset is incremented in multi-
- * 	ples of BITS_PER_BYTE(8) bits otherwise behavior is unspecified
+ * The shorter of the two parts is saved aside while the longer one is 
+ * shifted into place, so at most half the stream is buffered
  *
- * @param [in] *bx\n
- *   	Bitstream x
- * @param [in] *by\n
- *   	Bitstream y
- * @returns Pointer to object of type BitStream holding the result of xor 
- * 	operation explained above
+ * @param [in,out] *bs\n
+ * 	bit stream to rotate
+ * @param [in] k\n
+ * 	number of bits to rotate by, towards the start when positive
+ * @returns number of bits in bs, 0 on error
  */
-BitStream* BitStreamExclusiveOr(BitStream *bx, BitStream *by) {
-   BitStream* bz = NULL;
+uint64_t BitStreamRotateInPlace(BitStream *bs, int64_t k) {
+   uint8_t  local[ROTATE_SCRATCH_BYTES];
+   uint8_t  *tmp = local;
+   uint64_t n, r;
 
-   uint16_t offsetx, offsety;
-   uint8_t bytex, bytey;
+   if (bs == NULL || bs->nbits == 0)
+      return 0;
 
-   offsetx = 0;
-   offsety = 0;
+   n = bs->nbits;
+   r = rotation(k, n);
+   if (BITS_TO_BYTES(MIN(r, n - r)) > sizeof(local) &&
+       (tmp = malloc(BITS_TO_BYTES(MIN(r, n - r)))) == NULL)
+      return 0;
 
-   if (bx && by) {
-      bz = BitStreamCreate(bx->nbits);
-      if (bz) {
-         while (BitStreamGetByte(bx, &bytex, offsetx, BITS_PER_BYTE) > 0) {
-            if (BitStreamGetByte(by, &bytey, offsety, BITS_PER_BYTE)) {
-               BitStreamPutByte(bz, bytex^bytey, offsetx, BITS_PER_BYTE);
-	    }
-	    offsetx += BITS_PER_BYTE;
-
-	    offsety = (offsety + BITS_PER_BYTE) % by->nbits;
-         }
-      }
+   if (r <= n - r) {
+      bitcopy(tmp, 0, bs->array, 0, r);
+      bitcopy(bs->array, 0, bs->array, r, n - r);
+      bitcopy(bs->array, n - r, tmp, 0, r);
+   } else {
+      bitcopy(tmp, 0, bs->array, r, n - r);
+      bitcopyback(bs->array, n - r, bs->array, 0, r);
+      bitcopy(bs->array, 0, tmp, 0, n - r);
    }
-   return bz;
-}
 
+   if (tmp != local)
+      free(tmp);
+   return n;
+}
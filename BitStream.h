@@ -26,21 +26,132 @@
  */
 #define MIN(a,b)	((a) < (b) ? (a) : (b))
 
+/**
+ * @def BITSTREAM_MAX_BITS
+ * @brief Largest bit count a BitStream can hold, bounded so that the byte
+ * 	size of the container always fits in size_t
+ */
+#define BITSTREAM_MAX_BITS						\
+	((uint64_t)SIZE_MAX >= UINT64_MAX / BITS_PER_BYTE ?		\
+	 UINT64_MAX - (BITS_PER_BYTE - 1) :				\
+	 (uint64_t)SIZE_MAX * BITS_PER_BYTE)
+
+/**
+ * @def BITS_TO_BYTES
+ * @brief Number of bytes needed to hold given number of bits, caller has to
+ * 	ensure nbits does not exceed BITSTREAM_MAX_BITS
+ */
+#define BITS_TO_BYTES(nbits)	\
+	((size_t)(((uint64_t)(nbits) + BITS_PER_BYTE - 1) / BITS_PER_BYTE))
+
+/**
+ * @def BASE64_ENCODED_SIZE
+ * @brief Number of Base64 characters, padding included, encoding n bytes
+ */
+#define BASE64_ENCODED_SIZE(n)	(((size_t)(n) + 2) / 3 * 4)
+
+/**
+ * @def BASE64_DECODED_SIZE
+ * @brief Upper bound on the number of bytes decoded from n Base64 characters
+ */
+#define BASE64_DECODED_SIZE(n)	((size_t)(n) / 4 * 3 + ((size_t)(n) % 4 * 3 + 3) / 4)
+
+/**
+ * @def BASE64_URLSAFE
+ * @brief Base64 decoding flag, use the URL and filename safe alphabet with
+ * 	'-' and '_' in place of '+' and '/'
+ */
+#define BASE64_URLSAFE		0x01
+
+/**
+ * @def BASE64_SKIPSPACE
+ * @brief Base64 decoding flag, ignore white space (line breaks etc.)
+ */
+#define BASE64_SKIPSPACE	0x02
+
+/**
+ * @def BITSTREAM_BORROWED
+ * @brief BitStream flag: array belongs to somebody else, see BitStreamWrap
+ */
+#define BITSTREAM_BORROWED	0x01
+
+/**
+ * @def BITSTREAM_ARENA
+ * @brief BitStream flag: the object itself lives in a BitStreamArena or
+ * 	BitStreamPool and is not freed by BitStreamDelete
+ */
+#define BITSTREAM_ARENA		0x02
+
+/**
+ * @def BITSTREAM_INLINE
+ * @brief BitStream flag: array points to the storage inside the object
+ */
+#define BITSTREAM_INLINE	0x04
+
+/**
+ * @def BITSTREAM_INLINE_BYTES
+ * @brief streams of up to this many bytes keep their bits inside the object
+ */
+#define BITSTREAM_INLINE_BYTES	16
+
+/**
+ * @def BITSTREAM_ARENA_BLOCK
+ * @brief default number of bytes a BitStreamArena takes from malloc at a time
+ */
+#define BITSTREAM_ARENA_BLOCK	((size_t)64 * 1024)
+
+/**
+ * @def XOR_PATTERN_BYTES
+ * @brief Minimum size of the expanded key pattern used for repeating key
+ * 	xor, short keys are repeated up to this size
+ */
+#define XOR_PATTERN_BYTES	1024
+
+/**
+ * @def XOR_KEYSIZE_PAIRS
+ * @brief Most block pairs averaged per key size by BitStreamRankXorKeySizes
+ */
+#define XOR_KEYSIZE_PAIRS	64
+
+/**
+ * @def XOR_KEYSIZE_CANDIDATES
+ * @brief Number of key sizes BitStreamBreakRepeatingXor solves in full
+ */
+#define XOR_KEYSIZE_CANDIDATES	3
+
+/**
+ * @def BITREADER_MAX_PEEK
+ * @brief Widest field that BitReaderPeek can return, the bit buffer always
+ * 	holds at least this many bits after a refill
+ */
+#define BITREADER_MAX_PEEK	56
+
 /**
  * @def DECL_BYTE_OFFSET
  * @brief creates a variable to hold byte offset from input param "offset"
  */
 #define DECL_BYTE_OFFSET(a)	\
-	uint16_t a = (offset) / BITS_PER_BYTE;
+	uint64_t a = (offset) / BITS_PER_BYTE;
 
 /**
  * @def DECL_BITS_OFFSET
  * @brief creates a variable to hold bits offset from input param "offset"
  */
 #define DECL_BITS_OFFSET(a)	\
-	uint16_t a = (offset) % BITS_PER_BYTE;
+	uint64_t a = (offset) % BITS_PER_BYTE;
 
 /* Type Definitions */
+/**
+ * @enum BitStreamOrder
+ * @brief Bit order of multi-bit fields read from or written to a stream
+ */
+typedef enum BitStreamOrder {
+   /**< @brief first bit is the MSB of the field and of its byte (network) */
+   BITSTREAM_MSB_FIRST = 0,
+   /**< @brief first bit is the LSB of the field and of its byte */
+   BITSTREAM_LSB_FIRST
+} BitStreamOrder;
+
 /**
  * @struct BitStream
  * @brief This represents the bit stream for manipulation
@@ -49,39 +160,359 @@ typedef struct BitStream {
    /**< @brief container for bit stream */
    uint8_t 	*array;
    /**< @brief number of bits in the container */
-   uint16_t	nbits;
+   uint64_t	nbits;
+   /**< @brief bytes available at array, at least BITS_TO_BYTES(nbits) */
+   size_t	capacity;
+   /**< @brief BITSTREAM_BORROWED, BITSTREAM_ARENA, BITSTREAM_INLINE */
+   uint32_t	flags;
+   /**< @brief bits of short streams, see BITSTREAM_INLINE_BYTES */
+   uint8_t	storage[BITSTREAM_INLINE_BYTES];
 } BitStream;
 
+/**
+ * @struct BitStreamArena
+ * @brief Bump allocator handing out bit streams together with their bits,
+ * 	released all at once, see BitStreamArenaInit
+ */
+typedef struct BitStreamArena {
+   /**< @brief newest block, the one being carved */
+   struct BitStreamArenaBlock *head;
+   /**< @brief size of a regular block */
+   size_t	blocksize;
+} BitStreamArena;
+
+/**
+ * @struct BitStreamPool
+ * @brief Free list of fixed capacity bit streams, see BitStreamPoolInit
+ */
+typedef struct BitStreamPool {
+   /**< @brief memory the slots are carved from */
+   BitStreamArena arena;
+   /**< @brief first free slot, linked through their array pointers */
+   BitStream	*free;
+   /**< @brief capacity of a slot in bits */
+   uint64_t	maxbits;
+} BitStreamPool;
+
+/**
+ * @struct BitReader
+ * @brief Cursor for reading a bit stream sequentially through a 64 bit 
+ * 	buffer, see BitReaderInit
+ */
+typedef struct BitReader {
+   /**< @brief buffer of the stream being read */
+   const uint8_t *array;
+   /**< @brief number of bits in the stream */
+   uint64_t	nbits;
+   /**< @brief number of bytes in the stream */
+   size_t	nbytes;
+   /**< @brief next byte to be loaded into the bit buffer */
+   size_t	pos;
+   /**< @brief bits loaded but not yet consumed */
+   uint64_t	buffer;
+   /**< @brief number of valid bits in buffer */
+   uint32_t	count;
+   /**< @brief bit order of the fields */
+   BitStreamOrder order;
+} BitReader;
+
+/**
+ * @struct BitWriter
+ * @brief Cursor for writing a bit stream sequentially through a 64 bit 
+ * 	buffer, see BitWriterInit
+ */
+typedef struct BitWriter {
+   /**< @brief buffer of the stream being written */
+   uint8_t	*array;
+   /**< @brief number of bits in the stream */
+   uint64_t	nbits;
+   /**< @brief number of bytes in the stream */
+   size_t	nbytes;
+   /**< @brief next byte to be stored from the bit buffer */
+   size_t	pos;
+   /**< @brief bits written but not yet stored */
+   uint64_t	buffer;
+   /**< @brief number of valid bits in buffer */
+   uint32_t	count;
+   /**< @brief bit order of the fields */
+   BitStreamOrder order;
+} BitWriter;
+
+/**
+ * @struct HexEncoder
+ * @brief Incremental HEX ascii encoder, see HexEncoderInit
+ */
+typedef struct HexEncoder {
+   /**< @brief non zero for upper case digits */
+   int		upper;
+} HexEncoder;
 
-uint16_t BitStreamGetSizeBits(BitStream *bs) ;
+/**
+ * @struct HexDecoder
+ * @brief Incremental HEX ascii decoder carrying an odd digit between
+ * 	chunks, see HexDecoderInit
+ */
+typedef struct HexDecoder {
+   /**< @brief value of the pending high digit, -1 if there is none */
+   int		nibble;
+   /**< @brief number of characters consumed so far */
+   uint64_t	offset;
+} HexDecoder;
+
+/**
+ * @struct Base64Encoder
+ * @brief Incremental Base64 encoder carrying up to 2 input bytes between
+ * 	chunks, see Base64EncoderInit
+ */
+typedef struct Base64Encoder {
+   /**< @brief bytes of the incomplete 3 byte group */
+   uint8_t	carry[2];
+   /**< @brief number of bytes in carry */
+   uint32_t	ncarry;
+} Base64Encoder;
+
+/**
+ * @struct Base64Decoder
+ * @brief Incremental Base64 decoder carrying up to 3 characters (as bits)
+ * 	between chunks, see Base64DecoderInit
+ */
+typedef struct Base64Decoder {
+   /**< @brief BASE64_URLSAFE, BASE64_SKIPSPACE */
+   uint32_t	flags;
+   /**< @brief sextets of the incomplete quantum */
+   uint32_t	acc;
+   /**< @brief number of sextets in acc */
+   uint32_t	n;
+   /**< @brief number of '=' seen */
+   uint32_t	pad;
+   /**< @brief number of characters consumed so far */
+   uint64_t	offset;
+} Base64Decoder;
+
+/**
+ * @struct LineReader
+ * @brief Read only memory mapping of a text file handing out its lines in
+ * 	place, see LineReaderOpen
+ */
+typedef struct LineReader {
+   /**< @brief mapped file contents, NULL for an empty file */
+   const char	*data;
+   /**< @brief size of the file in bytes */
+   size_t	size;
+   /**< @brief start of the next line */
+   size_t	offset;
+} LineReader;
+
+/**
+ * @struct XorKeyScore
+ * @brief Single byte XOR key and the English score of its plain text, see
+ * 	BitStreamRankXorKeys
+ */
+typedef struct XorKeyScore {
+   /**< @brief key byte */
+   uint8_t	key;
+   /**< @brief EnglishScore of the plain text, higher is more English */
+   float	score;
+} XorKeyScore;
+
+/**
+ * @struct XorKeySize
+ * @brief Repeating XOR key size and the normalised Hamming distance of
+ * 	its blocks, see BitStreamRankXorKeySizes
+ */
+typedef struct XorKeySize {
+   /**< @brief key size in bytes */
+   uint32_t	keysize;
+   /**< @brief mean differing bits per byte between blocks, lower is better */
+   float	distance;
+} XorKeySize;
+
+
+uint64_t BitStreamGetSizeBits(BitStream *bs) ;
 
 uint8_t* BitStreamGetArray(BitStream *bs) ;
 
-BitStream* BitStreamCreate(uint16_t nbits) ;
+BitStream* BitStreamCreate(uint64_t nbits) ;
 
 BitStream* BitStreamCreateHex(const char* s) ;
 
 BitStream* BitStreamCreateAscii(const char* s) ;
 
+BitStream* BitStreamCreateBase64(const char* s, uint32_t flags) ;
+
+BitStream* BitStreamWrap(uint8_t *buffer, uint64_t nbits) ;
+
+BitStream* BitStreamSlice(BitStream *bs, uint64_t offset, uint64_t nbits) ;
+
+void BitStreamArenaInit(BitStreamArena *arena, size_t blocksize) ;
+
+BitStream* BitStreamArenaCreate(BitStreamArena *arena, uint64_t nbits) ;
+
+void BitStreamArenaReset(BitStreamArena *arena) ;
+
+void BitStreamArenaFree(BitStreamArena *arena) ;
+
+void BitStreamPoolInit(BitStreamPool *pool, uint64_t maxbits) ;
+
+BitStream* BitStreamPoolGet(BitStreamPool *pool, uint64_t nbits) ;
+
+void BitStreamPoolPut(BitStreamPool *pool, BitStream *bs) ;
+
+void BitStreamPoolFree(BitStreamPool *pool) ;
+
 void BitStreamDelete(BitStream* bs) ;
 
+int BitStreamRealloc(BitStream* bs, uint8_t *buffer, uint64_t nbits) ;
+
 void BitStreamShow(BitStream* bs) ;
 
-uint16_t BitStreamPutByte(BitStream* bs, uint8_t byte, uint16_t offset, 
-	uint16_t nbits) ;
+uint64_t BitStreamToHex(BitStream* bs, char* out, size_t size, int upper) ;
+
+uint64_t BitStreamPutByte(BitStream* bs, uint8_t byte, uint64_t offset, 
+	uint64_t nbits) ;
+
+uint64_t BitStreamGetByte(BitStream *bs, uint8_t *byte, uint64_t offset, 
+		uint64_t nbits) ;
 
-uint16_t BitStreamGetByte(BitStream *bs, uint8_t *byte, uint16_t offset, 
-		uint16_t nbits) ;
+uint64_t BitStreamPutBits(BitStream *bs, uint64_t value, uint64_t offset, 
+		uint64_t nbits, BitStreamOrder order) ;
 
-uint16_t BitStreamCopy(BitStream* bs, uint8_t* inp, uint16_t nbits) ;
+uint64_t BitStreamGetBits(BitStream *bs, uint64_t *value, uint64_t offset, 
+		uint64_t nbits, BitStreamOrder order) ;
 
-uint16_t BitStreamCopyHex(BitStream* bs, const char* inp) ;
+int BitReaderInit(BitReader *br, BitStream *bs, uint64_t offset, 
+		BitStreamOrder order) ;
 
-uint16_t BitStreamCopyAscii(BitStream* bs, const char* inp) ;
+uint64_t BitReaderTell(BitReader *br) ;
 
-uint16_t BitStreamFill(BitStream* bs, uint8_t byte) ;
+uint64_t BitReaderRemaining(BitReader *br) ;
+
+uint64_t BitReaderPeek(BitReader *br, uint32_t nbits) ;
+
+uint64_t BitReaderSkip(BitReader *br, uint64_t nbits) ;
+
+uint64_t BitReaderConsume(BitReader *br, uint32_t nbits) ;
+
+int BitWriterInit(BitWriter *bw, BitStream *bs, uint64_t offset, 
+		BitStreamOrder order) ;
+
+uint64_t BitWriterTell(BitWriter *bw) ;
+
+uint64_t BitWriterPut(BitWriter *bw, uint64_t value, uint32_t nbits) ;
+
+uint64_t BitWriterFlush(BitWriter *bw) ;
+
+uint64_t BitStreamCopy(BitStream* bs, const uint8_t* inp, uint64_t nbits) ;
+
+uint64_t BitStreamCopyBits(BitStream* dst, uint64_t dstOffset, BitStream* src,
+	uint64_t srcOffset, uint64_t nbits) ;
+
+uint64_t BitStreamCopyHex(BitStream* bs, const char* inp) ;
+
+uint64_t BitStreamCopyHexN(BitStream* bs, const char* inp, size_t len) ;
+
+uint64_t BitStreamCopyAscii(BitStream* bs, const char* inp) ;
+
+uint64_t BitStreamCopyAsciiN(BitStream* bs, const char* inp, size_t size) ;
+
+uint64_t BitStreamCopyBase64(BitStream* bs, const char* inp, uint32_t flags,
+	size_t* errpos) ;
+
+uint64_t BitStreamCopyBase64N(BitStream* bs, const char* inp, size_t len,
+	uint32_t flags, size_t* errpos) ;
+
+uint64_t BitStreamFill(BitStream* bs, uint8_t byte) ;
 
 BitStream* BitStreamHex2Base64(BitStream *bs) ;
 
+uint64_t BitStreamToBase64(BitStream* bs, char* out, size_t size) ;
+
+void HexEncoderInit(HexEncoder *enc, int upper) ;
+
+size_t HexEncoderUpdate(HexEncoder *enc, const uint8_t *in, size_t len, 
+		char *out) ;
+
+void HexDecoderInit(HexDecoder *dec) ;
+
+int64_t HexDecoderUpdate(HexDecoder *dec, const char *in, size_t len, 
+		uint8_t *out, size_t *errpos) ;
+
+int HexDecoderFinal(HexDecoder *dec, size_t *errpos) ;
+
+void Base64EncoderInit(Base64Encoder *enc) ;
+
+size_t Base64EncoderUpdate(Base64Encoder *enc, const uint8_t *in, size_t len,
+		char *out) ;
+
+size_t Base64EncoderFinal(Base64Encoder *enc, char *out) ;
+
+void Base64DecoderInit(Base64Decoder *dec, uint32_t flags) ;
+
+int64_t Base64DecoderUpdate(Base64Decoder *dec, const char *in, size_t len,
+		uint8_t *out, size_t *errpos) ;
+
+int64_t Base64DecoderFinal(Base64Decoder *dec, uint8_t *out, size_t *errpos) ;
+
 BitStream* BitStreamExclusiveOr(BitStream *bx, BitStream *by) ;
+
+uint64_t BitStreamXorInto(BitStream *dst, BitStream *bx, BitStream *by) ;
+
+uint64_t BitStreamXorInPlace(BitStream *bx, BitStream *by) ;
+
+float EnglishScore(const uint8_t *buf, size_t n) ;
+
+float BitStreamEnglishScore(BitStream *bs) ;
+
+int BitStreamRankXorKeys(BitStream *bs, XorKeyScore *best, int n) ;
+
+int LineReaderOpen(LineReader *lr, const char *path) ;
+
+int LineReaderNext(LineReader *lr, const char **line, size_t *len) ;
+
+void LineReaderClose(LineReader *lr) ;
+
+uint64_t BitStreamAppendBits(BitStream *bs, uint64_t value, uint32_t nbits,
+		BitStreamOrder order) ;
+
+uint64_t BitStreamAppendBytes(BitStream *bs, const uint8_t *buf, size_t n) ;
+
+uint64_t BitStreamAppendStream(BitStream *bs, BitStream *src) ;
+
+uint64_t BitStreamPopcount(BitStream *bs) ;
+
+uint64_t BitStreamPopcountRange(BitStream *bs, uint64_t offset, 
+		uint64_t nbits) ;
+
+uint64_t BitStreamHammingDistance(BitStream *a, BitStream *b) ;
+
+uint64_t BitStreamHammingDistanceRange(BitStream *a, uint64_t aOffset,
+		BitStream *b, uint64_t bOffset, uint64_t nbits) ;
+
+int BitStreamRankXorKeySizes(BitStream *bs, uint32_t minsize, 
+		uint32_t maxsize, XorKeySize *best, int n) ;
+
+uint64_t BitStreamBreakRepeatingXor(BitStream *bs, uint32_t maxsize, 
+		BitStream *key) ;
+
+BitStream* BitStreamTranspose(BitStream *bs, uint64_t stride) ;
+
+uint64_t BitStreamTransposeBits8(BitStream *bs) ;
+
+uint64_t BitStreamTransposeBits64(BitStream *bs) ;
+
+uint64_t BitStreamToBitPlanes(BitStream *bs) ;
+
+uint64_t BitStreamFromBitPlanes(BitStream *bs) ;
+
+BitStream* BitStreamShiftLeft(BitStream *bs, uint64_t k) ;
+
+BitStream* BitStreamShiftRight(BitStream *bs, uint64_t k) ;
+
+uint64_t BitStreamShiftLeftInPlace(BitStream *bs, uint64_t k) ;
+
+uint64_t BitStreamShiftRightInPlace(BitStream *bs, uint64_t k) ;
+
+BitStream* BitStreamRotate(BitStream *bs, int64_t k) ;
+
+uint64_t BitStreamRotateInPlace(BitStream *bs, int64_t k) ;
 #endif /* _BITSTREAM_H */
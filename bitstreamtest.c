@@ -0,0 +1,694 @@
+#include "BitStream.h"
+
+/**
+ * Regression checks for the BitStream library, run by ctest
+ *
+ * Each check returns 0 when it passes, a failing check prints its name
+ */
+
+#define CHECK(cond, name)	\
+	do { if (!(cond)) { printf("FAIL %s\n", name); return (1); } } while (0)
+
+/**
+ * @fn static int Bit(const uint8_t *a, uint64_t i)
+ * @brief bit i of byte array a in stream order, the reference for checks
+ */
+static int Bit(const uint8_t *a, uint64_t i) {
+   return (a[i / BITS_PER_BYTE] >> (7 - i % BITS_PER_BYTE)) & 1;
+}
+
+/**
+ * @fn static void FillPattern(uint8_t *a, size_t n, uint32_t seed)
+ * @brief fills a with reproducible pseudo random bytes
+ */
+static void FillPattern(uint8_t *a, size_t n, uint32_t seed) {
+   size_t i;
+
+   for (i = 0; i < n; i++) {
+      seed = seed * 1103515245 + 12345;
+      a[i] = (uint8_t)(seed >> 16);
+   }
+}
+
+/**
+ * @fn static int SameCopy(const uint8_t *after, const uint8_t *before,
+ * 	uint64_t size, uint64_t doff, const uint8_t *src, uint64_t soff,
+ * 	uint64_t n)
+ * @brief checks after holds before with bits [doff, doff + n) replaced by
+ * 	bits [soff, soff + n) of src, comparing bit by bit
+ */
+static int SameCopy(const uint8_t *after, const uint8_t *before, 
+		uint64_t size, uint64_t doff, const uint8_t *src, uint64_t soff,
+		uint64_t n) {
+   uint64_t i;
+
+   for (i = 0; i < size; i++) {
+      if (i >= doff && i < doff + n) {
+         if (Bit(after, i) != Bit(src, soff + i - doff))
+            return 0;
+      } else if (Bit(after, i) != Bit(before, i)) {
+         return 0;
+      }
+   }
+   return 1;
+}
+
+/**
+ * Copies between two streams at every source and destination alignment, 
+ * with lengths around the 64 bit words and 256 bit registers of the bulk
+ * copy, must leave the bits around the destination range alone
+ */
+static int CheckCopyBits(void) {
+   static const uint64_t lens[] = { 0, 1, 2, 7, 8, 9, 56, 63, 64, 65, 
+	   71, 72, 127, 128, 129, 255, 256, 257, 263, 264, 520 };
+   uint8_t   before[96];
+   BitStream *dst, *src;
+   uint64_t  soff, doff;
+   size_t    l;
+
+   dst = BitStreamCreate(sizeof(before) * BITS_PER_BYTE);
+   src = BitStreamCreate(sizeof(before) * BITS_PER_BYTE);
+   CHECK(dst != NULL && src != NULL, "copy create");
+   FillPattern(src->array, sizeof(before), 1);
+
+   for (soff = 0; soff < 17; soff++)
+   for (doff = 0; doff < 17; doff++)
+   for (l = 0; l < sizeof(lens) / sizeof(lens[0]); l++) {
+      FillPattern(before, sizeof(before), (uint32_t)(soff * 17 + doff));
+      memcpy(dst->array, before, sizeof(before));
+      CHECK(BitStreamCopyBits(dst, doff, src, soff, lens[l]) == lens[l], 
+		      "copy count");
+      CHECK(SameCopy(dst->array, before, dst->nbits, doff, src->array, soff,
+			      lens[l]), "copy bits");
+   }
+
+   BitStreamDelete(dst);
+   BitStreamDelete(src);
+   return (0);
+}
+
+/**
+ * Copies inside one stream, forwards and backwards, with and without the
+ * same alignment of both offsets within a byte
+ */
+static int CheckCopyBitsOverlap(void) {
+   static const uint64_t offs[] = { 0, 1, 3, 8, 13, 64, 170, 171, 602 };
+   static const uint64_t lens[] = { 1, 7, 8, 63, 64, 65, 255, 300, 1192 };
+   uint8_t   before[256];
+   BitStream *bs;
+   size_t    s, d, l;
+
+   bs = BitStreamCreate(sizeof(before) * BITS_PER_BYTE);
+   CHECK(bs != NULL, "overlap create");
+
+   for (s = 0; s < sizeof(offs) / sizeof(offs[0]); s++)
+   for (d = 0; d < sizeof(offs) / sizeof(offs[0]); d++)
+   for (l = 0; l < sizeof(lens) / sizeof(lens[0]); l++) {
+      if (offs[s] + lens[l] > bs->nbits || offs[d] + lens[l] > bs->nbits)
+         continue;
+      FillPattern(before, sizeof(before), (uint32_t)(s * 100 + d * 10 + l));
+      memcpy(bs->array, before, sizeof(before));
+      CHECK(BitStreamCopyBits(bs, offs[d], bs, offs[s], lens[l]) == lens[l],
+		      "overlap count");
+      CHECK(SameCopy(bs->array, before, bs->nbits, offs[d], before, offs[s],
+			      lens[l]), "overlap bits");
+   }
+
+   BitStreamDelete(bs);
+   return (0);
+}
+
+/**
+ * BitWriter must only touch the bits it writes, the bytes after the writer
+ * position keep their contents
+ */
+static int CheckWriterPreservesTail(void) {
+   BitStream *bs;
+   BitWriter bw;
+   int       i;
+
+   bs = BitStreamCreate(16 * BITS_PER_BYTE);
+   CHECK(bs != NULL, "writer create");
+
+   /* 2 bits at offset 3 of 0xAA 0xAA, MSB first */
+   memset(bs->array, 0xAA, 16);
+   BitWriterInit(&bw, bs, 3, BITSTREAM_MSB_FIRST);
+   BitWriterPut(&bw, 0, 2);
+   BitWriterFlush(&bw);
+   CHECK(bs->array[0] == 0xA2 && bs->array[1] == 0xAA, "writer msb partial");
+
+   /* same field LSB first, bits 3 and 4 counted from the LSB */
+   memset(bs->array, 0xAA, 16);
+   BitWriterInit(&bw, bs, 3, BITSTREAM_LSB_FIRST);
+   BitWriterPut(&bw, 3, 2);
+   BitWriterFlush(&bw);
+   CHECK(bs->array[0] == 0xBA && bs->array[1] == 0xAA, "writer lsb partial");
+
+   /* 70 zero bits from offset 0 leave bytes 9 to 15 alone */
+   memset(bs->array, 0xAA, 16);
+   BitWriterInit(&bw, bs, 0, BITSTREAM_MSB_FIRST);
+   BitWriterPut(&bw, 0, 64);
+   BitWriterPut(&bw, 0, 6);
+   BitWriterFlush(&bw);
+   for (i = 0; i < 8; i++)
+      CHECK(bs->array[i] == 0, "writer words");
+   CHECK(bs->array[8] == 0x02, "writer last partial byte");
+   for (i = 9; i < 16; i++)
+      CHECK(bs->array[i] == 0xAA, "writer tail");
+
+   BitStreamDelete(bs);
+   return (0);
+}
+
+/**
+ * A borrowed stream resized down to BITSTREAM_INLINE_BYTES or less moves 
+ * its bits into the inline storage and lets go of the wrapped buffer
+ */
+static int CheckBorrowedShrinkGoesInline(void) {
+   uint8_t   buffer[64];
+   BitStream *bs;
+   int       i;
+
+   for (i = 0; i < 64; i++)
+      buffer[i] = (uint8_t)i;
+
+   bs = BitStreamWrap(buffer, 64 * BITS_PER_BYTE);
+   CHECK(bs != NULL, "wrap");
+   CHECK(BitStreamRealloc(bs, NULL, 10 * BITS_PER_BYTE) == 0, "shrink");
+   CHECK(bs->array == bs->storage, "shrink inline");
+   CHECK((bs->flags & BITSTREAM_INLINE) && 
+	 !(bs->flags & BITSTREAM_BORROWED), "shrink flags");
+   CHECK(memcmp(bs->array, buffer, 10) == 0, "shrink contents");
+
+   /* the wrapped memory is no longer written through the stream */
+   bs->array[0] = 0xFF;
+   CHECK(buffer[0] == 0, "shrink detached");
+
+   BitStreamDelete(bs);
+
+   /* same size realloc keeps the view */
+   bs = BitStreamWrap(buffer, 8 * BITS_PER_BYTE);
+   CHECK(bs != NULL, "wrap short");
+   CHECK(BitStreamRealloc(bs, NULL, 8 * BITS_PER_BYTE) == 0 && 
+	 bs->array == buffer, "same size stays borrowed");
+   BitStreamDelete(bs);
+
+   return (0);
+}
+
+/**
+ * Hex decoding of known strings, of lengths on either side of the 16 and 
+ * 32 character SIMD blocks, and of an invalid character at every position
+ */
+static int CheckHexDecode(void) {
+   static const size_t sizes[] = { 1, 7, 8, 9, 15, 16, 17, 23, 24, 25, 
+	   31, 32, 33, 47, 48, 49, 64, 65 };
+   static const char bad[] = "/:@G`g \xff";
+   uint8_t    bytes[65], out[66];
+   char       hex[131];
+   HexDecoder dec;
+   BitStream  *bs;
+   size_t     s, i, b, errpos;
+
+   bs = BitStreamCreateHex("1c0111001f010100061a024b53535009181c");
+   CHECK(bs != NULL && bs->nbits == 18 * BITS_PER_BYTE && 
+	 memcmp(bs->array, "\x1c\x01\x11\x00\x1f\x01\x01\x00\x06\x1a\x02"
+		 "\x4b\x53\x53\x50\x09\x18\x1c", 18) == 0, "hex known");
+   BitStreamDelete(bs);
+
+   for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+      FillPattern(bytes, sizes[s], (uint32_t)s);
+      for (i = 0; i < sizes[s]; i++)
+         snprintf(hex + 2 * i, 3, i % 2 ? "%02X" : "%02x", bytes[i]);
+
+      HexDecoderInit(&dec);
+      CHECK(HexDecoderUpdate(&dec, hex, 2 * sizes[s], out, NULL) == 
+		      (int64_t)sizes[s] && HexDecoderFinal(&dec, NULL) == 0 &&
+	    memcmp(out, bytes, sizes[s]) == 0, "hex decode");
+
+      for (i = 0; i < 2 * sizes[s]; i++) {
+         for (b = 0; b < sizeof(bad) - 1; b++) {
+            char c = hex[i];
+
+            hex[i] = bad[b];
+            errpos = (size_t)-1;
+            HexDecoderInit(&dec);
+            CHECK(HexDecoderUpdate(&dec, hex, 2 * sizes[s], out, &errpos) 
+			    == -1 && errpos == i, "hex invalid position");
+            hex[i] = c;
+         }
+      }
+   }
+   return (0);
+}
+
+/**
+ * @var Rfc4648
+ * @brief test vectors of RFC 4648 section 10, plain text and Base64
+ */
+static const char *Rfc4648[][2] = {
+   { "",       ""         },
+   { "f",      "Zg=="     },
+   { "fo",     "Zm8="     },
+   { "foo",    "Zm9v"     },
+   { "foob",   "Zm9vYg==" },
+   { "fooba",  "Zm9vYmE=" },
+   { "foobar", "Zm9vYmFy" },
+};
+
+/**
+ * @fn static size_t RefBase64(const uint8_t *in, size_t n, char *out)
+ * @brief one sextet at a time Base64 encoder, the reference for checks
+ */
+static size_t RefBase64(const uint8_t *in, size_t n, char *out) {
+   static const char digits[] = 
+	   "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+   size_t   i, len = 0;
+   uint32_t v;
+
+   for (i = 0; i < n; i += 3) {
+      v = (uint32_t)in[i] << 16;
+      if (i + 1 < n)
+         v |= (uint32_t)in[i + 1] << 8;
+      if (i + 2 < n)
+         v |= in[i + 2];
+      out[len++] = digits[(v >> 18) & 63];
+      out[len++] = digits[(v >> 12) & 63];
+      out[len++] = i + 1 < n ? digits[(v >> 6) & 63] : '=';
+      out[len++] = i + 2 < n ? digits[v & 63] : '=';
+   }
+   out[len] = '\0';
+   return len;
+}
+
+/**
+ * Base64 encoding of the RFC 4648 vectors and of every length from 1 to 256
+ * bytes, which covers both sides of the 24 and 48 byte blocks of the AVX2
+ * and AVX-512 kernels and all 256 byte values
+ */
+static int CheckBase64Encode(void) {
+   uint8_t   bytes[256];
+   char      out[BASE64_ENCODED_SIZE(256) + 1], ref[sizeof(out)];
+   BitStream *bs;
+   size_t    i, n;
+
+   for (i = 0; i < sizeof(Rfc4648) / sizeof(Rfc4648[0]); i++) {
+      n  = strlen(Rfc4648[i][0]);
+      bs = BitStreamCreate(n * BITS_PER_BYTE);
+      CHECK(bs != NULL, "base64 encode create");
+      if (n)
+         memcpy(bs->array, Rfc4648[i][0], n);
+      out[0] = '\0';
+      CHECK(BitStreamToBase64(bs, out, sizeof(out)) == 
+		      strlen(Rfc4648[i][1]) && strcmp(out, Rfc4648[i][1]) == 0,
+		      "base64 encode rfc 4648");
+      BitStreamDelete(bs);
+   }
+
+   for (i = 0; i < sizeof(bytes); i++)
+      bytes[i] = (uint8_t)(i * 167 + 13);
+
+   for (n = 1; n <= sizeof(bytes); n++) {
+      bs = BitStreamCreate(n * BITS_PER_BYTE);
+      CHECK(bs != NULL, "base64 encode create");
+      memcpy(bs->array, bytes + sizeof(bytes) - n, n);
+      CHECK(BitStreamToBase64(bs, out, sizeof(out)) == 
+		      RefBase64(bytes + sizeof(bytes) - n, n, ref) &&
+	    strcmp(out, ref) == 0, "base64 encode");
+      BitStreamDelete(bs);
+   }
+   return (0);
+}
+
+/**
+ * @fn static int64_t Base64Decode(const char *in, size_t len, 
+ * 	uint32_t flags, uint8_t *out, size_t *errpos)
+ * @brief decodes a whole Base64 string with a fresh decoder
+ */
+static int64_t Base64Decode(const char *in, size_t len, uint32_t flags, 
+		uint8_t *out, size_t *errpos) {
+   Base64Decoder dec;
+   int64_t       n, tail;
+
+   Base64DecoderInit(&dec, flags);
+   n = Base64DecoderUpdate(&dec, in, len, out, errpos);
+   if (n < 0)
+      return (-1);
+   tail = Base64DecoderFinal(&dec, out + n, errpos);
+   return tail < 0 ? -1 : n + tail;
+}
+
+/**
+ * Base64 decoding of the RFC 4648 vectors, of every length around the 16
+ * and 32 character SIMD blocks in both alphabets, with white space at any 
+ * position, and of an invalid character at every position
+ */
+static int CheckBase64Decode(void) {
+   static const char bad[] = "*.-_~ \x80";
+   uint8_t   bytes[96], out[BASE64_DECODED_SIZE(129 + 3)];
+   char      b64[BASE64_ENCODED_SIZE(96) + 2];
+   BitStream *bs;
+   size_t    i, k, n, len, errpos;
+   char      c;
+
+   for (i = 1; i < sizeof(Rfc4648) / sizeof(Rfc4648[0]); i++) {
+      bs = BitStreamCreateBase64(Rfc4648[i][1], 0);
+      n  = strlen(Rfc4648[i][0]);
+      CHECK(bs != NULL && bs->nbits == n * BITS_PER_BYTE && 
+	    memcmp(bs->array, Rfc4648[i][0], n) == 0, "base64 decode rfc 4648");
+      BitStreamDelete(bs);
+   }
+
+   FillPattern(bytes, sizeof(bytes), 8);
+   for (n = 1; n <= sizeof(bytes); n++) {
+      len = RefBase64(bytes, n, b64);
+      CHECK(Base64Decode(b64, len, 0, out, NULL) == (int64_t)n && 
+	    memcmp(out, bytes, n) == 0, "base64 decode");
+
+      for (i = 0; i < len; i++) {
+         if (b64[i] == '+')
+            b64[i] = '-';
+         else if (b64[i] == '/')
+            b64[i] = '_';
+      }
+      CHECK(Base64Decode(b64, len, BASE64_URLSAFE, out, NULL) == (int64_t)n &&
+	    memcmp(out, bytes, n) == 0, "base64 decode url safe");
+   }
+
+   /* 48 bytes make 64 characters, two AVX2 or four SSSE3 blocks */
+   len = RefBase64(bytes, 48, b64);
+   for (i = 0; i <= len; i++) {
+      memmove(b64 + i + 1, b64 + i, len - i + 1);
+      b64[i] = i % 2 ? '\n' : ' ';
+      CHECK(Base64Decode(b64, len + 1, BASE64_SKIPSPACE, out, NULL) == 48 &&
+	    memcmp(out, bytes, 48) == 0, "base64 decode white space");
+      memmove(b64 + i, b64 + i + 1, len - i + 1);
+   }
+
+   for (n = 11; n <= 49; n += 12) {
+      for (k = n; k <= n + 2; k++) {
+         len = RefBase64(bytes, k, b64);
+         for (i = 0; i < len * (sizeof(bad) - 1); i++) {
+            c = b64[i % len];
+            b64[i % len] = bad[i / len];
+            errpos = (size_t)-1;
+            CHECK(Base64Decode(b64, len, 0, out, &errpos) == -1 && 
+		  errpos == i % len, "base64 invalid position");
+            b64[i % len] = c;
+         }
+      }
+   }
+   return (0);
+}
+
+/**
+ * @fn static uint64_t RefOnes(const uint8_t *a, uint64_t aoff, 
+ * 	const uint8_t *b, uint64_t boff, uint64_t nbits)
+ * @brief bit by bit count of a ^ b (of a when b is NULL), the reference 
+ */
+static uint64_t RefOnes(const uint8_t *a, uint64_t aoff, const uint8_t *b,
+		uint64_t boff, uint64_t nbits) {
+   uint64_t i, n = 0;
+
+   for (i = 0; i < nbits; i++)
+      n += Bit(a, aoff + i) ^ (b ? Bit(b, boff + i) : 0);
+   return n;
+}
+
+/**
+ * Popcount and Hamming distance of all ones, all zeros and random bytes 
+ * for sizes around the 256 and 512 byte blocks of the AVX-512 and AVX2 
+ * kernels, the 8 byte popcnt words, and at unaligned offsets across the 
+ * realignment chunks
+ */
+static int CheckPopcount(void) {
+   static const size_t sizes[] = { 1, 7, 8, 9, 255, 256, 257, 511, 512, 
+	   513, 1023, 1024, 1025, 4095, 4096, 4097, 9000 };
+   static const uint64_t offs[] = { 0, 1, 5, 8, 13, 4096 * 8 - 3 };
+   BitStream *ones, *zeros, *ra, *rb;
+   uint64_t  n, len;
+   size_t    s, o;
+
+   ones  = BitStreamCreate(9000 * BITS_PER_BYTE);
+   zeros = BitStreamCreate(9000 * BITS_PER_BYTE);
+   ra    = BitStreamCreate(9000 * BITS_PER_BYTE);
+   rb    = BitStreamCreate(9000 * BITS_PER_BYTE);
+   CHECK(ones && zeros && ra && rb, "popcount create");
+   memset(ones->array, 0xFF, 9000);
+   FillPattern(ra->array, 9000, 21);
+   FillPattern(rb->array, 9000, 12);
+
+   for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+      n = (uint64_t)sizes[s] * BITS_PER_BYTE;
+      CHECK(BitStreamPopcountRange(ones, 0, n) == n, "popcount ones");
+      CHECK(BitStreamPopcountRange(zeros, 0, n) == 0, "popcount zeros");
+      CHECK(BitStreamHammingDistanceRange(ones, 0, zeros, 0, n) == n, 
+		      "hamming ones zeros");
+      CHECK(BitStreamHammingDistanceRange(ra, 0, ra, 0, n) == 0, 
+		      "hamming self");
+      CHECK(BitStreamPopcountRange(ra, 0, n) == RefOnes(ra->array, 0, 
+			      NULL, 0, n), "popcount bytes");
+      CHECK(BitStreamHammingDistanceRange(ra, 0, rb, 0, n) == 
+		      RefOnes(ra->array, 0, rb->array, 0, n), "hamming bytes");
+
+      for (o = 0; o < sizeof(offs) / sizeof(offs[0]); o++) {
+         len = MIN(n, ra->nbits - offs[o] - 7);
+         CHECK(BitStreamPopcountRange(ones, offs[o], len) == len, 
+			 "popcount ones offset");
+         CHECK(BitStreamPopcountRange(ra, offs[o], len) == 
+			 RefOnes(ra->array, offs[o], NULL, 0, len), 
+			 "popcount offset");
+         CHECK(BitStreamHammingDistanceRange(ra, offs[o], rb, 7, len) == 
+			 RefOnes(ra->array, offs[o], rb->array, 7, len), 
+			 "hamming offset");
+      }
+   }
+
+   CHECK(BitStreamPopcount(ones) == ones->nbits && 
+	 BitStreamHammingDistance(ones, zeros) == ones->nbits, 
+	 "popcount whole stream");
+
+   BitStreamDelete(ones);
+   BitStreamDelete(zeros);
+   BitStreamDelete(ra);
+   BitStreamDelete(rb);
+   return (0);
+}
+
+/**
+ * 8x8 and 64x64 bit transposes and bit planes on known matrices and on 
+ * random blocks checked bit by bit, with block counts on either side of
+ * the 4 blocks of the GFNI kernel; partial trailing blocks stay as is
+ */
+static int CheckTransposeBits(void) {
+   static const uint8_t diag[8] = { 0x80, 0x40, 0x20, 0x10, 
+	   0x08, 0x04, 0x02, 0x01 };
+   static const uint8_t row0[8] = { 0xFF, 0, 0, 0, 0, 0, 0, 0 };
+   static const uint8_t col0[8] = { 0x80, 0x80, 0x80, 0x80, 
+	   0x80, 0x80, 0x80, 0x80 };
+   uint8_t   before[1030];
+   BitStream *bs;
+   uint64_t  nblocks, k, i, j, nbytes;
+
+   bs = BitStreamCreate(8 * BITS_PER_BYTE);
+   CHECK(bs != NULL, "transpose create");
+   memcpy(bs->array, diag, 8);
+   CHECK(BitStreamTransposeBits8(bs) == 64 && memcmp(bs->array, diag, 8) == 0,
+		   "transpose8 diagonal");
+   memcpy(bs->array, row0, 8);
+   CHECK(BitStreamTransposeBits8(bs) == 64 && memcmp(bs->array, col0, 8) == 0,
+		   "transpose8 row");
+   BitStreamDelete(bs);
+
+   for (nblocks = 1; nblocks <= 9; nblocks++) {
+      nbytes = 8 * nblocks + 3;
+      bs = BitStreamCreate(nbytes * BITS_PER_BYTE);
+      CHECK(bs != NULL, "transpose create");
+      FillPattern(before, nbytes, (uint32_t)nblocks);
+      memcpy(bs->array, before, nbytes);
+      CHECK(BitStreamTransposeBits8(bs) == nblocks * 64, "transpose8 count");
+      for (k = 0; k < nblocks; k++)
+         for (i = 0; i < 8; i++)
+            for (j = 0; j < 8; j++)
+               CHECK(Bit(bs->array + 8 * k, 8 * i + j) == 
+			       Bit(before + 8 * k, 8 * j + i), "transpose8");
+      CHECK(memcmp(bs->array + 8 * nblocks, before + 8 * nblocks, 3) == 0,
+		      "transpose8 tail");
+      BitStreamDelete(bs);
+   }
+
+   bs = BitStreamCreate(sizeof(before) * BITS_PER_BYTE);
+   CHECK(bs != NULL, "transpose create");
+   FillPattern(before, sizeof(before), 24);
+   memcpy(bs->array, before, sizeof(before));
+   CHECK(BitStreamTransposeBits64(bs) == 2 * 64 * 64, "transpose64 count");
+   for (k = 0; k < 2; k++)
+      for (i = 0; i < 64; i++)
+         for (j = 0; j < 64; j++)
+            CHECK(Bit(bs->array + 512 * k, 64 * i + j) == 
+			    Bit(before + 512 * k, 64 * j + i), "transpose64");
+   CHECK(memcmp(bs->array + 1024, before + 1024, 6) == 0, "transpose64 tail");
+
+   /* plane p holds bit p of each of the 64 bytes of a block */
+   memcpy(bs->array, before, sizeof(before));
+   CHECK(BitStreamToBitPlanes(bs) == 16 * 512, "bit planes count");
+   for (k = 0; k < 16; k++)
+      for (i = 0; i < 8; i++)
+         for (j = 0; j < 64; j++)
+            CHECK(Bit(bs->array + 64 * k, 64 * i + j) == 
+			    Bit(before + 64 * k, 8 * j + i), "bit planes");
+   CHECK(BitStreamFromBitPlanes(bs) == 16 * 512 && 
+	 memcmp(bs->array, before, sizeof(before)) == 0, "bit planes back");
+
+   BitStreamDelete(bs);
+   return (0);
+}
+
+/**
+ * @fn static int SameShift(const uint8_t *after, const uint8_t *before,
+ * 	uint64_t n, int64_t k, int rotate)
+ * @brief checks bit i of after is bit i + k of before, zero outside the n
+ * 	bits or taken mod n when rotating (k negative shifts to the end)
+ */
+static int SameShift(const uint8_t *after, const uint8_t *before, 
+		uint64_t n, int64_t k, int rotate) {
+   int64_t  from;
+   uint64_t i;
+
+   for (i = 0; i < n; i++) {
+      from = (int64_t)i + k;
+      if (rotate)
+         from = ((from % (int64_t)n) + (int64_t)n) % (int64_t)n;
+      if (Bit(after, i) != (from >= 0 && from < (int64_t)n ? 
+			      Bit(before, (uint64_t)from) : 0))
+         return 0;
+   }
+   return 1;
+}
+
+/**
+ * Shifts and rotations by 0, 1, a byte, a word and the whole stream of 
+ * sizes around the 256 bit AVX2 funnel, in and out of place
+ */
+static int CheckShiftRotate(void) {
+   static const uint64_t sizes[] = { 1, 9, 64, 255, 256, 257, 263, 520, 
+	   2049 };
+   uint8_t   before[257];
+   BitStream *bs, *out;
+   uint64_t  n, ks[10];
+   size_t    s, k;
+
+   bs = BitStreamCreateHex("8001");
+   CHECK(bs != NULL, "shift create");
+   out = BitStreamShiftLeft(bs, 1);
+   CHECK(out && out->array[0] == 0x00 && out->array[1] == 0x02, 
+		   "shift left known");
+   BitStreamDelete(out);
+   out = BitStreamShiftRight(bs, 1);
+   CHECK(out && out->array[0] == 0x40 && out->array[1] == 0x00, 
+		   "shift right known");
+   BitStreamDelete(out);
+   out = BitStreamRotate(bs, 1);
+   CHECK(out && out->array[0] == 0x00 && out->array[1] == 0x03, 
+		   "rotate known");
+   BitStreamDelete(out);
+   BitStreamDelete(bs);
+
+   for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+      n = sizes[s];
+      ks[0] = 0;  ks[1] = 1;  ks[2] = 7;  ks[3] = 8;  ks[4] = 63;
+      ks[5] = 64; ks[6] = 65; ks[7] = n - 1; ks[8] = n; ks[9] = n + 1;
+
+      bs = BitStreamCreate(n);
+      CHECK(bs != NULL, "shift create");
+      FillPattern(before, BITS_TO_BYTES(n), (uint32_t)n);
+      if (n % BITS_PER_BYTE)
+         before[n / BITS_PER_BYTE] &= 0xFF << (8 - n % BITS_PER_BYTE);
+
+      for (k = 0; k < sizeof(ks) / sizeof(ks[0]); k++) {
+         memcpy(bs->array, before, BITS_TO_BYTES(n));
+
+         out = BitStreamShiftLeft(bs, ks[k]);
+         CHECK(out && SameShift(out->array, before, n, (int64_t)ks[k], 0),
+			 "shift left");
+         BitStreamDelete(out);
+         out = BitStreamShiftRight(bs, ks[k]);
+         CHECK(out && SameShift(out->array, before, n, -(int64_t)ks[k], 0),
+			 "shift right");
+         BitStreamDelete(out);
+         out = BitStreamRotate(bs, (int64_t)ks[k]);
+         CHECK(out && SameShift(out->array, before, n, (int64_t)ks[k], 1),
+			 "rotate");
+         BitStreamDelete(out);
+         out = BitStreamRotate(bs, -(int64_t)ks[k]);
+         CHECK(out && SameShift(out->array, before, n, -(int64_t)ks[k], 1),
+			 "rotate back");
+         BitStreamDelete(out);
+
+         CHECK(BitStreamShiftLeftInPlace(bs, ks[k]) == n && 
+	       SameShift(bs->array, before, n, (int64_t)ks[k], 0), 
+	       "shift left in place");
+         memcpy(bs->array, before, BITS_TO_BYTES(n));
+         CHECK(BitStreamShiftRightInPlace(bs, ks[k]) == n && 
+	       SameShift(bs->array, before, n, -(int64_t)ks[k], 0), 
+	       "shift right in place");
+         memcpy(bs->array, before, BITS_TO_BYTES(n));
+         CHECK(BitStreamRotateInPlace(bs, (int64_t)ks[k]) == n && 
+	       SameShift(bs->array, before, n, (int64_t)ks[k], 1), 
+	       "rotate in place");
+         memcpy(bs->array, before, BITS_TO_BYTES(n));
+         CHECK(BitStreamRotateInPlace(bs, -(int64_t)ks[k]) == n && 
+	       SameShift(bs->array, before, n, -(int64_t)ks[k], 1), 
+	       "rotate back in place");
+      }
+      BitStreamDelete(bs);
+   }
+   return (0);
+}
+
+/**
+ * BitStreamXorInto with dst aliasing an operand: bx works, by works when 
+ * as long as bx and is refused, untouched, when it is the shorter key
+ */
+static int CheckXorIntoAliasing(void) {
+   BitStream *bx, *by, *key;
+
+   bx  = BitStreamCreateAscii("Burning 'em");
+   by  = BitStreamCreateAscii("Burning 'em");
+   key = BitStreamCreateAscii("ICE");
+   CHECK(bx && by && key, "xor create");
+
+   CHECK(BitStreamXorInto(key, bx, key) == 0 && key->nbits == 24 && 
+	 memcmp(key->array, "ICE", 3) == 0, "xor into short key refused");
+   CHECK(BitStreamXorInto(bx, bx, key) == bx->nbits && 
+	 memcmp(bx->array, "\x0b\x36\x37\x27\x2a\x2b\x2e\x63\x62\x2c\x2e", 
+		 11) == 0, "xor into bx");
+   CHECK(BitStreamXorInto(by, bx, by) == by->nbits && 
+	 memcmp(by->array, "ICEICEICEIC", 11) == 0, "xor into by");
+
+   BitStreamDelete(bx);
+   BitStreamDelete(by);
+   BitStreamDelete(key);
+   return (0);
+}
+
+int main() {
+   int fails = 0;
+
+   fails += CheckWriterPreservesTail();
+   fails += CheckBorrowedShrinkGoesInline();
+   fails += CheckCopyBits();
+   fails += CheckCopyBitsOverlap();
+   fails += CheckHexDecode();
+   fails += CheckBase64Encode();
+   fails += CheckBase64Decode();
+   fails += CheckPopcount();
+   fails += CheckTransposeBits();
+   fails += CheckShiftRotate();
+   fails += CheckXorIntoAliasing();
+
+   if (fails == 0)
+      printf("all checks passed\n");
+
+   return (fails ? 1 : 0);
+}
@@ -0,0 +1,98 @@
+#include "BitStream.h"
+/**
+ * the cryptopals crypto challenges
+ *
+ * Set 1 / Challenge 6
+ *
+ * Break repeating-key XOR
+ *
+ * There's a file here. It's been base64'd after being encrypted with 
+ * repeating-key XOR. Decrypt it.
+ *
+ * Here's how:
+ *
+ *   1. Let KEYSIZE be the guessed length of the key; try values from 2 to 
+ *      (say) 40.
+ *   2. For each KEYSIZE, take the first KEYSIZE worth of bytes, and the 
+ *      second KEYSIZE worth of bytes, and find the edit distance between 
+ *      them. Normalize this result by dividing by KEYSIZE.
+ *   3. The KEYSIZE with the smallest normalized edit distance is probably 
+ *      the key.
+ *   4. Now that you probably know the KEYSIZE: break the ciphertext into 
+ *      blocks of KEYSIZE length, transpose the blocks, and solve each block 
+ *      as if it was single-character XOR.
+ *   5. For each block, the single-byte XOR key that produces the best 
+ *      looking histogram is the repeating-key XOR key byte for that block. 
+ *      Put them together and you have the key.
+ *
+ * usage: breakrepeatkeyxor file
+ *
+ * file is the base64 cipher text of the challenge (6.txt)
+ */
+
+/**
+ * @def MAX_KEYSIZE
+ * @brief longest key to look for, in bytes
+ */
+#define MAX_KEYSIZE	40
+
+/**
+ * @def CHUNK
+ * @brief Base64 characters decoded at a time
+ */
+#define CHUNK		4096
+
+int main(int argc, char *argv[]) {
+   BitStream     *cipher, *key, *clear = NULL;
+   Base64Decoder dec;
+   LineReader    lr;
+   const char    *line;
+   size_t        len, n;
+   int64_t       size;
+   uint8_t       out[BASE64_DECODED_SIZE(CHUNK + 3)];
+
+   if (argc < 2) {
+      fprintf(stderr, "usage: %s file\n", argv[0]);
+      return (-1);
+   }
+   if (LineReaderOpen(&lr, argv[1])) {
+      perror(argv[1]);
+      return (-1);
+   }
+
+   cipher = BitStreamCreate(0);
+   key    = BitStreamCreate(0);
+   Base64DecoderInit(&dec, BASE64_SKIPSPACE);
+
+   /* decode line by line, appending to the cipher text */
+   while (cipher && LineReaderNext(&lr, &line, &len)) {
+      for (; len > 0; line += n, len -= n) {
+         n = MIN(len, CHUNK);
+         size = Base64DecoderUpdate(&dec, line, n, out, NULL);
+         if (size < 0)
+            goto out;
+         if (size > 0)
+            BitStreamAppendBytes(cipher, out, size);
+      }
+   }
+   size = Base64DecoderFinal(&dec, out, NULL);
+   if (cipher == NULL || size < 0)
+      goto out;
+   if (size > 0)
+      BitStreamAppendBytes(cipher, out, size);
+
+   if (key && BitStreamBreakRepeatingXor(cipher, MAX_KEYSIZE, key) > 0) {
+      BitStreamShow(key);
+      clear = BitStreamExclusiveOr(cipher, key);
+      if (clear)
+         BitStreamShow(clear);
+   }
+
+out:
+   BitStreamDelete(clear);
+   BitStreamDelete(key);
+   BitStreamDelete(cipher);
+   LineReaderClose(&lr);
+
+   return 0;
+}
@@ -1,3 +1,6 @@
+#include <pthread.h>
+#include <unistd.h>
+
 #include "BitStream.h"
 
 /**
@@ -22,158 +25,220 @@
  */
 
 /**
- * @def WORDLEN_SCORE_HIGH
- * @brief maximum word length score to qualify as english text
+ * @def DETECT_CHUNK
+ * @brief number of lines a worker claims from the shared cursor at a time
  */
-#define WORDLEN_SCORE_HIGH	6
+#define DETECT_CHUNK	256
 
 /**
- * @def WORDLEN_SCORE_LOW
- * @brief mininum word length score to qualify as english text
+ * @def DETECT_MAX_THREADS
+ * @brief upper limit on the worker pool
  */
-#define WORDLEN_SCORE_LOW	3
+#define DETECT_MAX_THREADS	256
 
 /**
- * @def NONPRINT_SCORE_HIGH
- * @brief upper limit on allowed non-printable characters 
+ * @struct LineScore
+ * @brief best single byte key of one input line
  */
-#define NONPRINT_SCORE_HIGH	3
+typedef struct LineScore {
+   size_t	line;	/**< index of the line in the input */
+   XorKeyScore	key;	/**< best key and its score */
+} LineScore;
 
 /**
- * @def NONPRINT_SCORE_LOW
- * @brief for now we don't allow any non-printable characters except '\r\n'
+ * @struct HexLine
+ * @brief one input line as a view into the mapped file
  */
-#define NONPRINT_SCORE_LOW	0
+typedef struct HexLine {
+   const char	*text;	/**< first hex character, not NULL terminated */
+   size_t	len;	/**< number of characters */
+} HexLine;
 
 /**
- * @def struct EnglishTextScore
- *
- * @breif parameters to measure closeness of string to english text
- *
- * This structure is not yet complete neither is the function operating on it
- * as several other parameters need to be considered before being able to filter
- * out seemingly looking garbled text
+ * @struct DetectJob
+ * @brief input lines shared by all workers
  */
-typedef struct EnglishTextScore {
-   uint16_t WordLengthScore;/**< typically text contains 5 letters per word */
-
-   uint16_t EtaoinScore;    /**< correlation to std etaoin histogram */
+typedef struct DetectJob {
+   HexLine	*lines;		/**< hex lines */
+   size_t	nlines;		/**< number of lines */
+   size_t	next;		/**< first line nobody has claimed yet */
+   int		k;		/**< number of lines to report */
+} DetectJob;
 
-   uint16_t NonPrintScore;  /**< number of non-printable characters in string */
-} EnglishTextScore;
+/**
+ * @struct DetectWorker
+ * @brief per thread state, the top k lines seen by this worker
+ */
+typedef struct DetectWorker {
+   pthread_t	thread;
+   DetectJob	*job;
+   LineScore	*top;
+   int		ntop;
+} DetectWorker;
 
-int CountNonPrintsInStream(uint8_t * buf, uint16_t size) {
-   int count = 0;
-   int i = 0;
-   while (i < size) {
-     if (!isprint(buf[i]))
-        count ++;
-     i ++;
+/**
+ * @fn void TopInsert(LineScore *top, int *ntop, int k, LineScore *s)
+ *
+ * @brief inserts s into the top list kept sorted by decreasing score, ties
+ * 	go to the earlier line so the result does not depend on the threads
+ */
+static void TopInsert(LineScore *top, int *ntop, int k, LineScore *s) {
+   int i;
+
+   for (i = *ntop; i > 0; i--) {
+      if (top[i - 1].key.score > s->key.score || 
+          (top[i - 1].key.score == s->key.score && top[i - 1].line < s->line))
+         break;
+      if (i < k)
+         top[i] = top[i - 1];
+   }
+   if (i < k) {
+      top[i] = *s;
+      if (*ntop < k)
+         (*ntop) ++;
    }
-   return count;
 }
 
 /**
- * @fn int CountWordsInStream(uint8_t* buf, uint16_t size)
+ * @fn void* DetectWorkerRun(void *arg)
  *
- * @brief quick and dirty word counting function 
- * 	this function find words separated by spaces alone! Multiple instances 
- * 	of spaces are taken as one separator
- * @param [in] buf\n
- * 	buffer in which we've to count words from
- * @param [in] size\n
- * 	length of the buffer in bytes
- * @returns number of words counted in the sentence
+ * @brief claims chunks of lines until the input is exhausted, ranking the
+ * 	keys of every line with its own scratch bit stream
  */
-
-int CountWordsInStream(uint8_t* buf, uint16_t size) {
-   int count = 0;
-   int i = 0;
-   while (i < size) {
-      while (i < size && buf[i] != ' ') 
-	i ++;
-      count ++;
-      while (i < size && buf[i] == ' ')
-	i ++;
+static void* DetectWorkerRun(void *arg) {
+   DetectWorker *w = arg;
+   DetectJob    *job = w->job;
+   BitStream    *cipher;
+   LineScore    s;
+   size_t       i, end;
+
+   cipher = BitStreamCreate(0);
+   if (cipher == NULL)
+      return NULL;
+
+   for (;;) {
+      i = __atomic_fetch_add(&job->next, DETECT_CHUNK, __ATOMIC_RELAXED);
+      if (i >= job->nlines)
+         break;
+      end = MIN(i + DETECT_CHUNK, job->nlines);
+
+      for (; i < end; i++) {
+         if (BitStreamCopyHexN(cipher, job->lines[i].text, 
+			     job->lines[i].len) > 0 &&
+             BitStreamRankXorKeys(cipher, &s.key, 1) == 1) {
+            s.line = i;
+            TopInsert(w->top, &w->ntop, job->k, &s);
+         }
+      }
    }
-   return count;
+
+   BitStreamDelete(cipher);
+   return NULL;
 }
 
 /**
- * @fn int EnglishTextScoreCalc(EnglishTextScore* score, uint8_t *buf, 
- * 	uint16_t size) 
+ * @fn int ReadLines(LineReader *lr, HexLine **lines, size_t *nlines)
  *
- * @brief Calculates "score" for english language coherency
+ * @brief collects views of all lines of the mapped file
+ * @returns 0 on success, -1 when out of memory
+ */
+static int ReadLines(LineReader *lr, HexLine **lines, size_t *nlines) {
+   HexLine *l;
+   size_t  n = 0, cap = 0;
+
+   *lines = NULL;
+   for (;;) {
+      if (n == cap) {
+         cap = cap ? 2 * cap : 1024;
+         l = realloc(*lines, cap * sizeof(HexLine));
+         if (l == NULL) {
+            free(*lines);
+            return (-1);
+         }
+         *lines = l;
+      }
+      if (!LineReaderNext(lr, &(*lines)[n].text, &(*lines)[n].len))
+         break;
+      n ++;
+   }
+   *nlines = n;
+   return 0;
+}
+
+/**
+ * usage: detectsinglexor [file [threads [k]]]
  *
- * @param [out] *score\n
- * 	pointer to score parameter structure to be filled 
- * @param [in] *buf\n
- * 	buffer to be parsed for calcualting the english language score
- * @param [in] size\n
- * 	length of the buffer in bytes
- * @returns average normalised score for the parsed text (should it be float?) 
+ * Scores every line of file (4.txt, of any length) on a pool of threads 
+ * (one per cpu) and prints the k (1) lines that decrypt to the most English
+ * text, best first
  */
+int main(int argc, char *argv[]) {
+   BitStream    *cipher, *clear, *key;
+   DetectWorker *workers;
+   DetectJob    job;
+   LineScore    *top;
+   LineReader   lr;
+   long         nthreads, started, i;
+   int          ntop = 0, j;
+
+   nthreads = argc > 2 ? atol(argv[2]) : sysconf(_SC_NPROCESSORS_ONLN);
+   nthreads = nthreads < 1 ? 1 : MIN(nthreads, DETECT_MAX_THREADS);
+
+   memset(&job, 0, sizeof(job));
+   job.k = argc > 3 ? atoi(argv[3]) : 1;
+   if (job.k < 1)
+      return (-1);
 
-int EnglishTextScoreCalc(EnglishTextScore* score, uint8_t *buf, uint16_t size) {
-    uint16_t nWords;
-
-    score->NonPrintScore = CountNonPrintsInStream(buf, size);
-
-    nWords = CountWordsInStream(buf, size);
-    if (nWords > 0)
-       score->WordLengthScore = size / nWords;
-    else
-       score->WordLengthScore = 100; /* out of range */
-
-    if ((score->WordLengthScore < WORDLEN_SCORE_HIGH && score->WordLengthScore
-		    > WORDLEN_SCORE_LOW) &&
-        (score->NonPrintScore < NONPRINT_SCORE_HIGH && score->NonPrintScore 
-	            > NONPRINT_SCORE_LOW) 
-       )
-       return score->WordLengthScore; 
-    else 
-       return (-1);
-}
+   if (LineReaderOpen(&lr, argc > 1 ? argv[1] : "4.txt"))
+      return (-1);
+   if (ReadLines(&lr, &job.lines, &job.nlines))
+      return (-1);
 
-int main() {
-   BitStream        *cipher, *clear;
-   BitStream        *key;
-   int 	      	    i;
-   uint16_t         size;
-   char             buffer[256];
-   FILE	            *fp = NULL;
-   EnglishTextScore score;
-
-   fp = fopen("4.txt", "r");
-   if (!fp) 
+   workers = calloc(nthreads, sizeof(DetectWorker));
+   top     = calloc((nthreads + 1) * job.k, sizeof(LineScore));
+   if (workers == NULL || top == NULL)
       return (-1);
 
-   memset(buffer, '\0', sizeof(buffer));
-
-   while (fgets(buffer, sizeof(buffer) - 1, fp)) {
-     buffer[strlen(buffer) - 1] = '\0';
-     cipher = BitStreamCreateHex(buffer); 
-
-     if (cipher) {
-        for (i = 53; i < 255; i++) { /* key = 0 means clear text */
-	   key = BitStreamCreate(BITS_PER_BYTE);
-	   if (key) {
-	      BitStreamPutByte(key, i, 0, BITS_PER_BYTE);
-	   
-              clear = BitStreamExclusiveOr(cipher, key);
-
-	      size = (BitStreamGetSizeBits(clear) + BITS_PER_BYTE - 1)/
-			   BITS_PER_BYTE;
-	      if (EnglishTextScoreCalc(&score, BitStreamGetArray(clear),size) 
-			      > 0) {
-	         BitStreamShow(clear);
-	      }
-
-	      BitStreamDelete(clear);
-           }
-	   BitStreamDelete(key);
-        }
-     }
-     memset(buffer, '\0', sizeof(buffer));
+   for (i = 0; i < nthreads; i++) {
+      workers[i].job = &job;
+      workers[i].top = top + (i + 1) * job.k;
    }
+   for (started = 0; started < nthreads; started++)
+      if (pthread_create(&workers[started].thread, NULL, DetectWorkerRun, 
+			      &workers[started]))
+         break;
+
+   /* short of threads, the main thread works through the rest */
+   if (started < nthreads)
+      DetectWorkerRun(&workers[started]);
+
+   /* reduce the per worker lists into the global top k */
+   for (i = 0; i < nthreads; i++) {
+      if (i < started)
+         pthread_join(workers[i].thread, NULL);
+      for (j = 0; j < workers[i].ntop; j++)
+         TopInsert(top, &ntop, job.k, &workers[i].top[j]);
+   }
+
+   cipher = BitStreamCreate(0);
+   key    = BitStreamCreate(BITS_PER_BYTE);
+   clear  = BitStreamCreate(0);
+
+   for (i = 0; cipher && key && clear && i < ntop; i++) {
+      BitStreamCopyHexN(cipher, job.lines[top[i].line].text, 
+		      job.lines[top[i].line].len);
+      BitStreamPutByte(key, top[i].key.key, 0, BITS_PER_BYTE);
+      if (BitStreamXorInto(clear, cipher, key) > 0)
+         BitStreamShow(clear);
+   }
+
+   BitStreamDelete(clear);
+   BitStreamDelete(key);
+   BitStreamDelete(cipher);
+   free(top);
+   free(workers);
+   free(job.lines);
+   LineReaderClose(&lr);
+
+   return 0;
 }
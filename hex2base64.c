@@ -23,7 +23,7 @@
  */
 int main() {
    BitStream *hex, *base64;
-   uint16_t offset = 0;
+   uint64_t offset = 0;
    uint8_t  byte = 0;
 
    if ((hex = BitStreamCreateHex("49276d206b696c6c696e6720796f757220627261696e206c696b65206120706f69736f6e6f7573206d757368726f6f6d")) != NULL) {